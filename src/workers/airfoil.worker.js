@@ -1,64 +1,234 @@
 import init from '../wasm/airfoil_simulator.js'
 
 let wasm
+// the worker's AnalysisCache, when the module has one: AoA and speed
+// changes reuse the previous solve
+let cache
+
+// simplifyTol (plot units, 0 for none) thins the streamlines before they
+// are packed
+function analysisOptions(simplifyTol) {
+  const options = wasm.default_analysis_options()
+  options.simplify_tolerance = Number(simplifyTol) || 0
+  return options
+}
+
+// packed layout (see PackedAnalysis): [cl | foil xz | mu | line 0 xz | ...],
+// offsets[s]..offsets[s + 1] spans section s
+function analyzePacked(naca, uFs, aoaDeg, nPanels, nStreams, simplifyTol) {
+  if (!cache && wasm.AnalysisCache) cache = new wasm.AnalysisCache()
+  const args = [naca, uFs, aoaDeg, nPanels, nStreams, analysisOptions(simplifyTol)]
+  const packed = cache ? cache.analyze_packed(...args) : wasm.analyze_airfoil_packed(...args)
+  try {
+    if (packed.err) throw new Error(packed.err)
+    // one copy each out of wasm memory; the views go stale once the heap grows
+    const data = packed.data().slice()
+    const offsets = packed.offsets().slice()
+    return { cl: packed.cl, data, offsets }
+  } finally {
+    packed.delete()
+  }
+}
+
+// fallback for modules built before analyze_airfoil_packed existed
+function analyzeLegacy(naca, uFs, aoaDeg, nPanels, nStreams) {
+  const res = wasm.analyze_airfoil(naca, uFs, aoaDeg, nPanels, nStreams)
+  const cl = res.cl
+
+  const mats = [res.airfoil_coords]
+  const nLines = res.streamlines.size()
+  for (let k = 0; k < nLines; k++) mats.push(res.streamlines.get(k))
+
+  let total = 1
+  for (const m of mats) total += wasm.matrix_rows(m) * 2
+  const data = new Float32Array(total)
+  const offsets = new Uint32Array(mats.length + 2)
+
+  data[0] = cl
+  let pos = 1
+  let section = 0
+  const appendXZ = (m) => {
+    offsets[section++] = pos
+    const rows = wasm.matrix_rows(m)
+    for (let i = 0; i < rows; i++) {
+      data[pos++] = wasm.matrix_coeff(m, i, 0)
+      data[pos++] = wasm.matrix_coeff(m, i, 1)
+    }
+  }
+
+  appendXZ(mats[0])
+  // mu is not copied on this path, so its section is empty
+  offsets[section++] = pos
+  for (let k = 1; k < mats.length; k++) appendXZ(mats[k])
+  offsets[section] = pos
+
+  for (let k = 1; k < mats.length; k++) mats[k]?.delete()
+  res.mu?.delete()
+  res.stream_field?.u?.delete()
+  res.stream_field?.v?.delete()
+  res.stream_field?.psi?.delete()
+  res.stream_field_single?.u?.delete()
+  res.stream_field_single?.v?.delete()
+  res.stream_field_single?.psi?.delete()
+  // modules from before the compact RegularGrid return x/z mesh matrices
+  res.stream_grid?.x?.delete?.()
+  res.stream_grid?.z?.delete?.()
+  res.streamlines?.delete?.()
+  res.airfoil_coords?.delete?.()
+  res?.delete?.()
+
+  return { cl, data, offsets }
+}
+
+// one debug line per pass; the per-line vectors are embind handles and are
+// freed here
+const LINE_ENDS = ['steps', 'length', 'outside', 'body', 'stagnation', 'min_step', 'separation']
+function logStats(label, stats) {
+  if (!stats) return
+  const vectors = [stats.line_steps, stats.line_lookups, stats.line_end]
+  try {
+    if (!stats.collected) return
+    let steps = 0
+    let lookups = 0
+    const ends = {}
+    for (let k = 0; k < stats.line_end.size(); k++) {
+      steps += stats.line_steps.get(k)
+      lookups += stats.line_lookups.get(k)
+      const end = LINE_ENDS[stats.line_end.get(k)]
+      ends[end] = (ends[end] || 0) + 1
+    }
+    console.debug(`[airfoil] ${label}`, {
+      solveMs: stats.solve_ms,
+      assembleMs: stats.assemble_ms,
+      factorMs: stats.factor_ms,
+      fieldMs: stats.field_ms,
+      streamlineMs: stats.streamline_ms,
+      totalMs: stats.total_ms,
+      reused: stats.reused_solution,
+      refactored: stats.refactored,
+      solveKernels: stats.solve_kernel_evals,
+      fieldKernels: stats.field_kernel_evals,
+      maskedPoints: stats.masked_points,
+      fieldPoints: stats.field_points,
+      steps,
+      lookups,
+      ends
+    })
+  } finally {
+    for (const v of vectors) v?.delete?.()
+  }
+}
+
+// id of the newest request; a progressive run that sees a newer one
+// cancels itself before its next pass
+let latestId = 0
+
+function post(id, final, { cl, data, offsets }) {
+  self.postMessage({ id, final, cl, data, offsets }, [data.buffer, offsets.buffer])
+}
+
+// one job for the worker's lifetime; each request restarts it, which keeps
+// its caches so an AoA change is a rank-1 update at every pass
+let job
+
+// debug collects and logs per-pass stats; off, the solver skips the
+// counting sampler and the per-line vectors
+async function runProgressive(id, naca, uFs, aoaDeg, nPanels, nStreams, simplifyTol, debug) {
+  const options = analysisOptions(simplifyTol)
+  options.collect_stats = debug
+  if (job?.restart) {
+    job.restart(naca, uFs, aoaDeg, nPanels, nStreams, options)
+  } else {
+    job?.delete()
+    job = new wasm.ProgressiveAnalysis(naca, uFs, aoaDeg, nPanels, nStreams, options)
+  }
+  // a newer request has restarted the job by the time this one sees its id
+  // is stale, so it only stops
+  while (id === latestId && !job.done()) {
+    const pass = job.pass_index()
+    const packed = job.pass()
+    let result
+    try {
+      if (packed.err) throw new Error(packed.err)
+      // frees the stats vectors; logs only when they were collected
+      logStats(`pass ${pass}`, packed.stats)
+      result = { cl: packed.cl, data: packed.data().slice(), offsets: packed.offsets().slice() }
+    } finally {
+      packed.delete()
+    }
+    post(id, job.done(), result)
+    // yield so a newer request can arrive before the next pass
+    await new Promise((resolve) => setTimeout(resolve, 0))
+  }
+}
+
+// jobs: [{ naca, aoaDeg, nPanels }]; replies with cl per job (NaN on
+// failure, with the message in errors) and, when withMu is set, the mu
+// table laid out by muOffsets
+// batches run one at a time on this worker, so it keeps a single
+// BatchWorkspace
+let batchWorkspace
+
+function runBatch(id, jobs, uFs, withMu) {
+  if (!wasm.analyze_batch) throw new Error('this build of the solver module has no analyze_batch')
+  const list = new wasm.VectorBatchJob()
+  for (const job of jobs) {
+    list.push_back({ naca: String(job.naca), aoa_deg: Number(job.aoaDeg), n: Number(job.nPanels) })
+  }
+  const options = { with_mu: !!withMu, with_fields: false, n_streamlines: 0, n_threads: 0 }
+  if (!batchWorkspace && wasm.BatchWorkspace) batchWorkspace = new wasm.BatchWorkspace()
+  const res = batchWorkspace
+    ? batchWorkspace.run(list, uFs, options)
+    : wasm.analyze_batch(list, uFs, options)
+  try {
+    const cl = res.cl().slice()
+    const mu = res.mu().slice()
+    const muOffsets = res.mu_offsets().slice()
+    const errVec = res.errors()
+    const errors = []
+    for (let k = 0; k < errVec.size(); k++) errors.push(errVec.get(k))
+    errVec.delete()
+    self.postMessage({ id, final: true, batch: true, cl, mu, muOffsets, errors }, [
+      cl.buffer,
+      mu.buffer,
+      muOffsets.buffer
+    ])
+  } finally {
+    res.delete()
+    list.delete()
+  }
+}
 
 self.onmessage = async (e) => {
-  const { naca, uFs, aoaDeg, nPanels, nStreams } = e.data || {}
+  const { id, type, naca, uFs, aoaDeg, nPanels, nStreams, simplifyTol } = e.data || {}
+  // stats logging: on in the dev server, or when the message asks for it
+  const debug = e.data?.debug ?? !!import.meta.env?.DEV
+  // a batch runs to completion and does not supersede plot requests
+  const isBatch = type === 'batch'
+  if (!isBatch) latestId = id
   try {
     if (!wasm) {
       wasm = await init()
     }
-
-    const res = await wasm.analyze_airfoil(
-      naca,
-      uFs,
-      aoaDeg,
-      nPanels,
-      nStreams
-    )
-
-    const cl = res.cl
-
-    const foilMat = res.airfoil_coords
-    const r = wasm.matrix_rows(foilMat)
-    const c = wasm.matrix_cols(foilMat)
-    const foil = new Float32Array(r * c)
-    for (let i = 0; i < r; i++) {
-      for (let j = 0; j < c; j++) {
-        foil[i * c + j] = wasm.matrix_coeff(foilMat, i, j)
-      }
+    if (isBatch) {
+      runBatch(id, e.data.jobs || [], uFs, e.data.withMu)
+      return
     }
+    if (id !== latestId) return
 
-    const nLines = res.streamlines.size()
-    const streamBuffers = []
-    for (let k = 0; k < nLines; k++) {
-      const m = res.streamlines.get(k)
-      const rr = wasm.matrix_rows(m)
-      const cc = wasm.matrix_cols(m)
-      const flat = new Float32Array(rr * cc)
-      for (let i = 0; i < rr; i++) {
-        for (let j = 0; j < cc; j++) {
-          flat[i * cc + j] = wasm.matrix_coeff(m, i, j)
-        }
-      }
-      streamBuffers.push(flat.buffer)
-      m?.delete()
+    if (wasm.ProgressiveAnalysis) {
+      await runProgressive(id, naca, uFs, aoaDeg, nPanels, nStreams, simplifyTol, !!debug)
+      return
     }
 
-    res.mu?.delete()
-    res.stream_field?.u?.delete()
-    res.stream_field?.v?.delete()
-    res.stream_grid?.x?.delete()
-    res.stream_grid?.z?.delete()
-    res.streamlines?.delete?.()
-    foilMat?.delete?.()
-    res?.delete?.()
-
-    self.postMessage(
-      { cl, foil, nLines, streamBuffers },
-      [foil.buffer, ...streamBuffers]
-    )
+    // these paths block until the result is ready, so let requests queued
+    // behind this one supersede it first
+    await new Promise((resolve) => setTimeout(resolve, 0))
+    if (id !== latestId) return
+
+    const analyze = wasm.analyze_airfoil_packed ? analyzePacked : analyzeLegacy
+    post(id, true, analyze(naca, uFs, aoaDeg, nPanels, nStreams, simplifyTol))
   } catch (err) {
-    self.postMessage({ error: String(err) })
+    self.postMessage({ id, error: String(err) })
   }
 }
@@ -0,0 +1,733 @@
+#pragma once
+
+#include "iterative_solver.hpp"
+#include "streamline_seeding.hpp"
+
+struct PanelAnalysis {
+    MatrixXd airfoil_coords;
+    VectorXd mu;
+    double cl;
+    VelocityField stream_field;
+    VelocityFieldF stream_field_single;   // filled instead of stream_field in single precision
+    RegularGrid stream_grid;
+    std::vector<MatrixXd> streamlines;
+    std::string err;
+    AnalysisStats stats;
+    // GMRES iterations or refinement steps; 0 for the direct solve
+    int solve_iterations = 0;
+    double solve_residual = 0.0;
+};
+
+template <typename Real>
+int count_masked(const Matrix<Real, Dynamic, Dynamic>& u) {
+    int masked = 0;
+    for (Index i = 0; i < u.size(); ++i) masked += std::isnan(u(i));
+    return masked;
+}
+
+// the last solved geometry/AoA; mu and the field are linear in u_fs, so a
+// u_fs change only rescales them
+struct ResultCache {
+    std::string naca;
+    int n = 0;
+    double aoa = 0.0;
+    double u_fs = 0.0;
+    double far_field_tolerance = 0.0;
+    bool single_precision = false;
+    bool lazy_field = false;
+    int mesh_points = 0;
+    MatrixXd airfoil_coords;
+    VectorXd mu;
+    double cl = 0.0;
+    VelocityField field;
+    VelocityFieldF field_single;
+    RegularGrid grid;
+    LazyVelocityField lazy;   // its memo carries over between calls on the same solution
+    bool iterative_solve = false;
+    bool mixed_precision_solve = false;
+    double solve_tolerance = 0.0;
+    double solve_far_field_tolerance = 0.0;
+    bool solve_hmatrix = false;
+    int solve_iterations = 0;
+    double solve_residual = 0.0;
+};
+
+// last result and factorization, reused by one caller between analyses
+struct AnalysisCache {
+    ResultCache result;
+    BodySolveCache solve;
+    FieldInfluenceCache field;   // only filled with cache_field_influence
+};
+
+inline void cache_release(AnalysisCache& cache) {
+    cache.result = ResultCache();
+    cache.solve = BodySolveCache();
+    release_field_cache(cache.field);
+}
+
+inline bool uses_lazy_field(const AnalysisOptions& options) {
+    return options.lazy_field && !options.contour_streamlines;
+}
+
+inline bool uses_mixed_solve(const AnalysisOptions& options) {
+    return options.mixed_precision_solve && !options.iterative_solve;
+}
+
+inline bool result_cache_matches(
+    const ResultCache& cache,
+    const std::string& naca_code,
+    int n,
+    double aoa,
+    const AnalysisOptions& options) {
+
+    return cache.u_fs != 0.0 && cache.n == n && cache.aoa == aoa && cache.naca == naca_code &&
+           cache.far_field_tolerance == options.far_field_tolerance &&
+           cache.single_precision == options.single_precision &&
+           cache.lazy_field == uses_lazy_field(options) &&
+           cache.mesh_points == options.mesh_points &&
+           cache.iterative_solve == options.iterative_solve &&
+           cache.mixed_precision_solve == uses_mixed_solve(options) &&
+           (!options.iterative_solve || (cache.solve_far_field_tolerance == options.solve_far_field_tolerance &&
+                                         cache.solve_hmatrix == options.solve_hmatrix)) &&
+           (!(options.iterative_solve || options.mixed_precision_solve) ||
+            cache.solve_tolerance == options.solve_tolerance) &&
+           (!options.contour_streamlines || cache.field.psi.size() > 0 || cache.field_single.psi.size() > 0);
+}
+
+inline void rescale_result(ResultCache& cache, double u_fs) {
+    double scale = u_fs / cache.u_fs;
+    cache.mu *= scale;
+    cache.field.u *= scale;
+    cache.field.v *= scale;
+    cache.field.psi *= scale;
+    cache.field_single.u *= float(scale);
+    cache.field_single.v *= float(scale);
+    cache.field_single.psi *= float(scale);
+    cache.lazy.mu *= scale;
+    cache.lazy.u_inf *= scale;
+    cache.lazy.v_inf *= scale;
+    cache.lazy.field.u *= scale;
+    cache.lazy.field.v *= scale;
+    cache.u_fs = u_fs;
+}
+
+// analyze_airfoil_with against caller-owned caches
+inline PanelAnalysis analyze_airfoil_cached(
+    ResultCache& result_cache,
+    BodySolveCache& solve_cache,
+    FieldInfluenceCache* field_cache,
+    const std::string& naca_code,
+    double u_fs,
+    double aoa_deg,
+    int n_panels,
+    int n_streamlines,
+    const AnalysisOptions& options) {
+   
+    auto t_start = std::chrono::steady_clock::now();
+    AnalysisStats stats;
+    try {
+        if (options.mesh_points < 2 || !(options.streamline_dt > 0.0)) {
+            throw std::invalid_argument("mesh_points must be at least 2 and streamline_dt positive");
+        }
+        double aoa = aoa_deg * M_PI / 180.0;
+        
+        double coeff = 2; 
+        double domain[4] = {-0.2 * coeff, 1.2 * coeff, -0.7 * coeff, 0.7 * coeff};
+
+        if (result_cache_matches(result_cache, naca_code, n_panels, aoa, options)) {
+            if (u_fs != result_cache.u_fs) rescale_result(result_cache, u_fs);
+            stats.reused_solution = true;
+        } else {
+            int factorizations = solve_cache.factorizations;
+            double solve_evals = solve_cache.kernel_evals;
+            double assemble_ms = solve_cache.assemble_ms, factor_ms = solve_cache.factor_ms;
+            auto t_solve = std::chrono::steady_clock::now();
+
+            MatrixXd airfoil_coords;
+            VectorXd mu;
+            IterativeSolveInfo solve_info;
+            if (options.iterative_solve) {
+                mu = solve_system_iterative(naca_code, n_panels, u_fs, aoa, options.solve_tolerance,
+                                            options.solve_far_field_tolerance, options.solve_hmatrix, options.n_threads,
+                                            airfoil_coords, solve_info, &stats.solve_kernel_evals);
+            } else if (uses_mixed_solve(options)) {
+                airfoil_coords = panelgen(naca_code, n_panels, aoa);
+                mu = solve_system_mixed(airfoil_coords, u_fs, n_panels, aoa, options.solve_tolerance, solve_info);
+                stats.refactored = true;
+                stats.solve_kernel_evals = double(n_panels) * (n_panels + 1);
+            } else {
+                mu = solve_system_cached(solve_cache, naca_code, n_panels, u_fs, aoa, airfoil_coords);
+                stats.refactored = solve_cache.factorizations != factorizations;
+                stats.solve_kernel_evals = solve_cache.kernel_evals - solve_evals;
+                stats.assemble_ms = solve_cache.assemble_ms - assemble_ms;
+                stats.factor_ms = solve_cache.factor_ms - factor_ms;
+            }
+            stats.solve_ms = elapsed_ms(t_solve);
+            
+            double cl = -2.0 * mu(n_panels) / u_fs;
+            RegularGrid stream_grid = create_mesh(
+                domain[0], domain[1], domain[2], domain[3], options.mesh_points, options.mesh_points);
+            
+            auto t_field = std::chrono::steady_clock::now();
+            double panels_per_point = n_panels + 1;
+            VelocityField stream_field;
+            VelocityFieldF stream_field_single;
+            LazyVelocityField lazy;
+            if (uses_lazy_field(options)) {
+                lazy = lazy_velocity_field(stream_grid, mu, airfoil_coords, u_fs, aoa, n_panels);
+            } else if (options.single_precision) {
+                stream_field_single = calculate_velocity_tiled_as<float>(
+                    stream_grid, mu, airfoil_coords, u_fs, aoa, n_panels,
+                    options.n_threads, options.contour_streamlines);
+            } else if (options.contour_streamlines) {
+                stream_field = calculate_velocity_tiled(
+                    stream_grid, mu, airfoil_coords, u_fs, aoa, n_panels,
+                    options.n_threads, true);
+            } else if (options.far_field_tolerance > 0.0) {
+                stream_field = calculate_velocity_tree(
+                    stream_grid, mu, airfoil_coords, u_fs, aoa, n_panels,
+                    options.far_field_tolerance, options.n_threads, &stats.field_kernel_evals);
+                panels_per_point = 0;
+            } else if (options.cache_field_influence && field_cache &&
+                       field_cache_fits(*field_cache, stream_grid, n_panels)) {
+                if (field_cache_matches(*field_cache, stream_grid, airfoil_coords, n_panels)) panels_per_point = 1;
+                stream_field = calculate_velocity_cached(
+                    *field_cache, stream_grid, mu, airfoil_coords, u_fs, aoa, n_panels);
+            } else {
+                if (field_cache) release_field_cache(*field_cache);
+                stream_field = calculate_velocity_tiled(
+                    stream_grid, mu, airfoil_coords, u_fs, aoa, n_panels, options.n_threads);
+            }
+            stats.field_ms = elapsed_ms(t_field);
+
+            if (options.collect_stats && !uses_lazy_field(options)) {
+                stats.masked_points = options.single_precision ? count_masked(stream_field_single.u)
+                                                               : count_masked(stream_field.u);
+                stats.field_kernel_evals += panels_per_point * (stream_grid.nx * stream_grid.nz - stats.masked_points);
+            }
+
+            result_cache = {naca_code, n_panels, aoa, u_fs, options.far_field_tolerance, options.single_precision,
+                            uses_lazy_field(options), options.mesh_points, airfoil_coords, mu, cl, stream_field, stream_field_single,
+                            stream_grid, lazy, options.iterative_solve, uses_mixed_solve(options), options.solve_tolerance,
+                            options.solve_far_field_tolerance, options.solve_hmatrix, solve_info.iterations,
+                            solve_info.residual};
+        }
+
+        const MatrixXd& airfoil_coords = result_cache.airfoil_coords;
+        const VectorXd& mu = result_cache.mu;
+        double cl = result_cache.cl;
+        const VelocityFieldF& stream_field_single = result_cache.field_single;
+        const RegularGrid& stream_grid = result_cache.grid;
+        
+        AnalysisStats* line_stats = options.collect_stats ? &stats : nullptr;
+        long lazy_evaluated = result_cache.lazy.evaluated;
+        auto t_lines = std::chrono::steady_clock::now();
+        std::vector<MatrixXd> streamlines;
+        if (options.contour_streamlines) {
+            streamlines = options.single_precision
+                ? stream_function_contours(stream_field_single.psi.cast<double>(), stream_grid, n_streamlines)
+                : stream_function_contours(result_cache.field.psi, stream_grid, n_streamlines);
+        } else if (result_cache.lazy_field) {
+            LazyGridSampler sampler(result_cache.lazy);
+            streamlines = seeded_streamlines<double>(sampler, stream_grid, u_fs, n_streamlines, options, line_stats);
+        } else if (options.single_precision) {
+            streamlines = seeded_streamlines<float>(
+                BasicGridSampler<float>(stream_field_single, stream_grid), stream_grid, u_fs, n_streamlines, options,
+                line_stats);
+        } else {
+            streamlines = seeded_streamlines<double>(
+                GridSampler(result_cache.field, stream_grid), stream_grid, u_fs, n_streamlines, options, line_stats);
+        }
+        stats.streamline_ms = elapsed_ms(t_lines);
+        const VelocityField& stream_field = result_cache.lazy_field ? result_cache.lazy.field : result_cache.field;
+
+        if (options.collect_stats) {
+            stats.collected = true;
+            stats.field_points = stream_grid.nx * stream_grid.nz;
+            if (result_cache.lazy_field) {
+                stats.masked_points = result_cache.lazy.inside.count();
+                stats.field_kernel_evals += double(result_cache.lazy.evaluated - lazy_evaluated) * (n_panels + 1);
+            } else if (stats.reused_solution) {
+                stats.masked_points = options.single_precision ? count_masked(stream_field_single.u)
+                                                               : count_masked(stream_field.u);
+            }
+            stats.total_ms = elapsed_ms(t_start);
+        }
+
+        PanelAnalysis res{
+            airfoil_coords,
+            mu,
+            cl,
+            stream_field,
+            stream_field_single,
+            stream_grid,
+            streamlines,
+            "",
+            options.collect_stats ? stats : AnalysisStats(),
+            result_cache.solve_iterations,
+            result_cache.solve_residual
+        };
+        return res;
+    } catch (const std::exception& e) {
+        return {MatrixXd(), VectorXd(), 0.0, VelocityField(), VelocityFieldF(), RegularGrid(), {}, e.what(),
+                AnalysisStats(), 0, 0.0};
+    }
+}
+
+inline PanelAnalysis cache_analyze(
+    AnalysisCache& cache,
+    const std::string& naca_code,
+    double u_fs,
+    double aoa_deg,
+    int n_panels,
+    int n_streamlines,
+    const AnalysisOptions& options) {
+
+    return analyze_airfoil_cached(cache.result, cache.solve, &cache.field, naca_code, u_fs, aoa_deg, n_panels,
+                                  n_streamlines, options);
+}
+
+inline PanelAnalysis analyze_airfoil_with(
+    const std::string& naca_code,
+    double u_fs,
+    double aoa_deg,
+    int n_panels,
+    int n_streamlines,
+    const AnalysisOptions& options) {
+
+    AnalysisCache cache;
+    return cache_analyze(cache, naca_code, u_fs, aoa_deg, n_panels, n_streamlines, options);
+}
+
+inline PanelAnalysis analyze_airfoil(
+    const std::string& naca_code,
+    double u_fs,
+    double aoa_deg,
+    int n_panels,
+    int n_streamlines = 20) {
+
+    return analyze_airfoil_with(naca_code, u_fs, aoa_deg, n_panels, n_streamlines, default_analysis_options());
+}
+
+
+// analyze_airfoil output in one float buffer:
+// [cl | foil x0 z0 x1 z1 ... | mu | line 0 x z ... | line 1 ... ]
+// section s spans [offsets[s], offsets[s + 1])
+struct PackedAnalysis {
+    std::vector<float> data;
+    std::vector<uint32_t> offsets;
+    double cl = 0.0;
+    std::string err;
+    AnalysisStats stats;
+    int solve_iterations = 0;
+    double solve_residual = 0.0;
+};
+
+inline void pack_body(PackedAnalysis& packed, double cl, const MatrixXd& airfoil_coords, const VectorXd& mu) {
+    packed.cl = cl;
+    packed.data.clear();
+    packed.offsets.clear();
+
+    packed.data.push_back(cl);
+    packed.offsets.push_back(packed.data.size());
+    for (Index i = 0; i < airfoil_coords.rows(); ++i) {
+        packed.data.push_back(airfoil_coords(i, 0));
+        packed.data.push_back(airfoil_coords(i, 1));
+    }
+
+    packed.offsets.push_back(packed.data.size());
+    for (Index i = 0; i < mu.size(); ++i) packed.data.push_back(mu(i));
+}
+
+inline void pack_analysis_into(const PanelAnalysis& res, PackedAnalysis& packed) {
+    packed.err = res.err;
+    packed.stats = res.stats;
+    packed.solve_iterations = res.solve_iterations;
+    packed.solve_residual = res.solve_residual;
+
+    size_t total = 1 + res.airfoil_coords.size() + res.mu.size();
+    for (const MatrixXd& line : res.streamlines) total += line.size();
+    packed.data.reserve(total);
+    packed.offsets.reserve(res.streamlines.size() + 3);
+
+    auto append_xy = [&](const MatrixXd& m) {
+        packed.offsets.push_back(packed.data.size());
+        for (Index i = 0; i < m.rows(); ++i) {
+            packed.data.push_back(m(i, 0));
+            packed.data.push_back(m(i, 1));
+        }
+    };
+
+    pack_body(packed, res.cl, res.airfoil_coords, res.mu);
+    for (const MatrixXd& line : res.streamlines) append_xy(line);
+    packed.offsets.push_back(packed.data.size());
+}
+
+inline PackedAnalysis pack_analysis(const PanelAnalysis& res) {
+    PackedAnalysis packed;
+    pack_analysis_into(res, packed);
+    return packed;
+}
+
+inline PackedAnalysis analyze_airfoil_packed(
+    const std::string& naca_code,
+    double u_fs,
+    double aoa_deg,
+    int n_panels,
+    int n_streamlines,
+    const AnalysisOptions& options) {
+
+    return pack_analysis(analyze_airfoil_with(naca_code, u_fs, aoa_deg, n_panels, n_streamlines, options));
+}
+
+inline PackedAnalysis cache_analyze_packed(
+    AnalysisCache& cache,
+    const std::string& naca_code,
+    double u_fs,
+    double aoa_deg,
+    int n_panels,
+    int n_streamlines,
+    const AnalysisOptions& options) {
+
+    return pack_analysis(cache_analyze(cache, naca_code, u_fs, aoa_deg, n_panels, n_streamlines, options));
+}
+
+// buffers kept between analyses; allocation-free on the direct double
+// field path once sized. high_water_bytes is the most they have held
+struct AirfoilWorkspace {
+    AnalysisCache cache;
+    SolveScratch solve_scratch;
+    MatrixXd panel_coord;
+    VectorXd mu;
+    RegularGrid grid;
+    FieldScratch field_scratch;
+    VelocityField field;
+    StreamlineBatch<double> lines;
+    PackedAnalysis packed;
+
+    bool valid = false;
+    std::string naca;
+    int n = 0;
+    double aoa = 0.0;
+    double u_fs = 0.0;
+
+    size_t high_water_bytes = 0;
+};
+
+inline size_t workspace_bytes(const AirfoilWorkspace& ws) {
+    const FieldScratch& fs = ws.field_scratch;
+    const PanelFrames& f = fs.frames;
+    const Collocation& c = ws.cache.solve.colloc;
+    size_t doubles = c.mid_x.size() + c.mid_z.size() + c.beta.size() + c.sin_beta.size() + c.cos_beta.size() +
+                     ws.cache.solve.panel_coord.size() + ws.cache.solve.lu.matrixLU().size() + ws.cache.solve.wake_col_ref.size() +
+                     ws.solve_scratch.B.size() + ws.solve_scratch.w.size() + ws.solve_scratch.z.size() +
+                     ws.solve_scratch.A.size() + ws.cache.solve.lu.permutationP().size() / 2 +
+                     ws.panel_coord.size() + ws.mu.size() + ws.field.u.size() + ws.field.v.size() +
+                     fs.mask.x_vec.size() + fs.mask.z_vec.size() + fs.mask.crossings.capacity() +
+                     fs.mu_gauge_free.size() + fs.body.size() +
+                     f.x1.size() + f.z1.size() + f.x2.size() + f.z2.size() + f.cos_a.size() + f.sin_a.size();
+    return doubles * sizeof(double) + fs.inside.size() * sizeof(bool) +
+           ws.packed.data.capacity() * sizeof(float) + ws.packed.offsets.capacity() * sizeof(uint32_t) +
+           streamline_batch_bytes(ws.lines);
+}
+
+// analyze_airfoil_packed into ws.packed; the other solver and field
+// options go through cache_analyze. false on error, message in ws.packed.err
+inline bool analyze_airfoil_into(
+    AirfoilWorkspace& ws,
+    const std::string& naca_code,
+    double u_fs,
+    double aoa_deg,
+    int n_panels,
+    int n_streamlines,
+    const AnalysisOptions& options) {
+
+    auto t_start = std::chrono::steady_clock::now();
+    PackedAnalysis& packed = ws.packed;
+    packed.err.clear();
+    clear_stats(packed.stats);
+
+    bool direct = !options.contour_streamlines && !options.lazy_field && !options.single_precision &&
+                  !options.cache_field_influence && !(options.far_field_tolerance > 0.0) &&
+                  !options.iterative_solve && !options.mixed_precision_solve;
+    if (!direct) {
+        ws.valid = false;
+        pack_analysis_into(cache_analyze(ws.cache, naca_code, u_fs, aoa_deg, n_panels, n_streamlines, options), packed);
+        ws.high_water_bytes = std::max(ws.high_water_bytes, workspace_bytes(ws));
+        return packed.err.empty();
+    }
+
+    try {
+        if (options.mesh_points < 2 || !(options.streamline_dt > 0.0)) {
+            throw std::invalid_argument("mesh_points must be at least 2 and streamline_dt positive");
+        }
+        double aoa = aoa_deg * M_PI / 180.0;
+
+        double coeff = 2;
+        double domain[4] = {-0.2 * coeff, 1.2 * coeff, -0.7 * coeff, 0.7 * coeff};
+        RegularGrid grid = create_mesh(
+            domain[0], domain[1], domain[2], domain[3], options.mesh_points, options.mesh_points);
+
+        if (ws.valid && ws.u_fs != 0.0 && ws.n == n_panels && ws.aoa == aoa && ws.naca == naca_code && same_grid(ws.grid, grid)) {
+            if (u_fs != ws.u_fs) {
+                double scale = u_fs / ws.u_fs;
+                ws.mu *= scale;
+                ws.field.u *= scale;
+                ws.field.v *= scale;
+                ws.u_fs = u_fs;
+            }
+            packed.stats.reused_solution = true;
+        } else {
+            ws.valid = false;
+            BodySolveCache& solve = ws.cache.solve;
+            int factorizations = solve.factorizations;
+            double solve_evals = solve.kernel_evals;
+            double assemble_ms = solve.assemble_ms, factor_ms = solve.factor_ms;
+            auto t_solve = std::chrono::steady_clock::now();
+            solve_system_cached_into(solve, naca_code, n_panels, u_fs, aoa, ws.panel_coord, ws.mu, ws.solve_scratch);
+            packed.stats.solve_ms = elapsed_ms(t_solve);
+            packed.stats.refactored = solve.factorizations != factorizations;
+            packed.stats.solve_kernel_evals = solve.kernel_evals - solve_evals;
+            packed.stats.assemble_ms = solve.assemble_ms - assemble_ms;
+            packed.stats.factor_ms = solve.factor_ms - factor_ms;
+
+            auto t_field = std::chrono::steady_clock::now();
+            ws.grid = grid;
+            calculate_velocity_tiled_into(ws.field, ws.field_scratch, ws.grid, ws.mu, ws.panel_coord,
+                                          u_fs, aoa, n_panels, options.n_threads, false);
+            packed.stats.field_ms = elapsed_ms(t_field);
+            ws.naca = naca_code;
+            ws.n = n_panels;
+            ws.aoa = aoa;
+            ws.u_fs = u_fs;
+            ws.valid = true;
+        }
+
+        double cl = -2.0 * ws.mu(n_panels) / u_fs;
+        pack_body(packed, cl, ws.panel_coord, ws.mu);
+
+        // a line with fewer than two points is rolled back
+        auto t_lines = std::chrono::steady_clock::now();
+        size_t line_start = 0;
+        trace_seeded_streamlines<double>(
+            GridSampler(ws.field, ws.grid), ws.grid, u_fs, n_streamlines, options,
+            [&]() {
+                line_start = packed.data.size();
+                packed.offsets.push_back(line_start);
+            },
+            [&](double x, double z) {
+                packed.data.push_back(x);
+                packed.data.push_back(z);
+            },
+            [&]() {
+                if (packed.data.size() - line_start < 4) {
+                    packed.data.resize(line_start);
+                    packed.offsets.pop_back();
+                }
+            },
+            options.collect_stats ? &packed.stats : nullptr, &ws.lines);
+        packed.offsets.push_back(packed.data.size());
+        packed.stats.streamline_ms = elapsed_ms(t_lines);
+
+        if (options.collect_stats) {
+            AnalysisStats& st = packed.stats;
+            st.collected = true;
+            st.field_points = ws.grid.nx * ws.grid.nz;
+            st.masked_points = ws.field_scratch.inside.count();
+            if (!st.reused_solution) st.field_kernel_evals = double(st.field_points - st.masked_points) * (n_panels + 1);
+            st.total_ms = elapsed_ms(t_start);
+        } else {
+            clear_stats(packed.stats);
+        }
+    } catch (const std::exception& e) {
+        ws.valid = false;
+        pack_body(packed, 0.0, MatrixXd(), VectorXd());
+        packed.offsets.push_back(packed.data.size());
+        packed.err = e.what();
+    }
+
+    ws.high_water_bytes = std::max(ws.high_water_bytes, workspace_bytes(ws));
+    return packed.err.empty();
+}
+
+struct BatchJob {
+    std::string naca;
+    double aoa_deg = 0.0;
+    int n = 200;
+};
+
+struct BatchOptions {
+    bool with_mu = false;      // fill the mu table
+    bool with_fields = false;  // also run the field and streamlines per job
+    int n_streamlines = 40;
+    int n_threads = 0;         // 0: hardware concurrency
+};
+
+// one row per job, in input order; a failed job has cl NaN and err[i] set
+struct BatchResult {
+    std::vector<double> cl;
+    std::vector<float> mu;
+    std::vector<uint32_t> mu_offsets;
+    std::vector<std::string> err;
+    std::vector<PackedAnalysis> packed;
+};
+
+// one AirfoilWorkspace per thread slot; not shared between batches
+struct BatchWorkspace {
+    std::vector<AirfoilWorkspace> slots;
+};
+
+// jobs grouped by (naca, n), one group per thread, so later angles are
+// rank-one updates. serial on the caller when the pool is busy
+inline BatchResult analyze_batch_into(BatchWorkspace& workspace, const std::vector<BatchJob>& jobs, double u_fs,
+                               const BatchOptions& options) {
+    std::vector<AirfoilWorkspace>& workspaces = workspace.slots;
+
+    int count = jobs.size();
+    BatchResult res;
+    res.cl.assign(count, std::numeric_limits<double>::quiet_NaN());
+    res.err.assign(count, std::string());
+    res.mu_offsets.assign(count + 1, 0);
+    for (int i = 0; i < count; ++i) {
+        int len = options.with_mu && jobs[i].n > 0 ? jobs[i].n + 1 : 0;
+        res.mu_offsets[i + 1] = res.mu_offsets[i] + len;
+    }
+    res.mu.assign(res.mu_offsets[count], std::numeric_limits<float>::quiet_NaN());
+    if (options.with_fields) res.packed.resize(count);
+    if (count == 0) return res;
+
+    std::vector<int> order(count);
+    for (int i = 0; i < count; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        const BatchJob& ja = jobs[a];
+        const BatchJob& jb = jobs[b];
+        if (ja.naca != jb.naca) return ja.naca < jb.naca;
+        if (ja.n != jb.n) return ja.n < jb.n;
+        return ja.aoa_deg < jb.aoa_deg;
+    });
+    std::vector<int> group_start;
+    for (int k = 0; k < count; ++k) {
+        if (k == 0 || jobs[order[k]].naca != jobs[order[k - 1]].naca || jobs[order[k]].n != jobs[order[k - 1]].n) {
+            group_start.push_back(k);
+        }
+    }
+    group_start.push_back(count);
+    int groups = group_start.size() - 1;
+
+    int threads = std::min(resolve_threads(options.n_threads), groups);
+    if ((int)workspaces.size() < threads) workspaces.resize(threads);
+
+    AnalysisOptions analysis = default_analysis_options();
+    analysis.n_threads = 1;
+
+    std::atomic<int> next_group{0};
+    parallel_for(threads, threads, [&](int slot) {
+        AirfoilWorkspace& ws = workspaces[slot];
+        for (int g = next_group++; g < groups; g = next_group++) {
+            for (int k = group_start[g]; k < group_start[g + 1]; ++k) {
+                int i = order[k];
+                const BatchJob& job = jobs[i];
+                try {
+                    if (options.with_fields) {
+                        if (!analyze_airfoil_into(ws, job.naca, u_fs, job.aoa_deg, job.n,
+                                                  options.n_streamlines, analysis)) {
+                            throw std::runtime_error(ws.packed.err);
+                        }
+                        res.packed[i] = ws.packed;
+                    } else {
+                        ws.valid = false;
+                        solve_system_cached_into(ws.cache.solve, job.naca, job.n, u_fs, job.aoa_deg * M_PI / 180.0,
+                                                 ws.panel_coord, ws.mu, ws.solve_scratch);
+                    }
+                    res.cl[i] = -2.0 * ws.mu(job.n) / u_fs;
+                    for (uint32_t m = res.mu_offsets[i]; m < res.mu_offsets[i + 1]; ++m) {
+                        res.mu[m] = ws.mu(m - res.mu_offsets[i]);
+                    }
+                } catch (const std::exception& e) {
+                    ws.valid = false;
+                    res.err[i] = e.what();
+                }
+            }
+        }
+    });
+    return res;
+}
+
+inline BatchResult analyze_batch(const std::vector<BatchJob>& jobs, double u_fs, const BatchOptions& options) {
+    BatchWorkspace workspace;
+    return analyze_batch_into(workspace, jobs, u_fs, options);
+}
+
+// coarse-to-fine analysis, one pass per call: a quarter of the panels on a
+// 50x50 mesh, then full panels on half the mesh, then the full analysis.
+// the caches survive restarts, so an AoA change is a rank-1 update
+const int PROGRESSIVE_PASSES = 3;
+
+struct ProgressiveAnalysis {
+    std::string naca;
+    double u_fs;
+    double aoa_deg;
+    int n_panels;
+    int n_streamlines;
+    AnalysisOptions options;
+    int next_pass = 0;
+    bool cancelled = false;
+
+    ResultCache results[PROGRESSIVE_PASSES];
+    BodySolveCache coarse_solve, full_solve;
+
+    ProgressiveAnalysis(const std::string& naca_code, double u, double aoa, int n, int streams,
+                        const AnalysisOptions& opts)
+        : naca(naca_code), u_fs(u), aoa_deg(aoa), n_panels(n), n_streamlines(streams), options(opts) {}
+};
+
+inline void progressive_restart(ProgressiveAnalysis& job, const std::string& naca_code, double u, double aoa, int n,
+                         int streams, const AnalysisOptions& opts) {
+    job.naca = naca_code;
+    job.u_fs = u;
+    job.aoa_deg = aoa;
+    job.n_panels = n;
+    job.n_streamlines = streams;
+    job.options = opts;
+    job.next_pass = 0;
+    job.cancelled = false;
+}
+
+inline bool progressive_done(const ProgressiveAnalysis& job) {
+    return job.cancelled || job.next_pass >= PROGRESSIVE_PASSES;
+}
+
+inline void progressive_cancel(ProgressiveAnalysis& job) {
+    job.cancelled = true;
+}
+
+inline int progressive_pass_index(const ProgressiveAnalysis& job) {
+    return job.next_pass;
+}
+
+// runs the next pass; err is set once cancelled or finished
+inline PackedAnalysis progressive_pass(ProgressiveAnalysis& job) {
+    if (progressive_done(job)) {
+        PackedAnalysis packed;
+        packed.err = job.cancelled ? "cancelled" : "no passes left";
+        return packed;
+    }
+
+    int pass = job.next_pass++;
+    AnalysisOptions options = job.options;
+    int n = job.n_panels;
+    BodySolveCache* solve = &job.full_solve;
+
+    if (pass == 0) {
+        n = std::min(job.n_panels, std::max(40, job.n_panels / 8 * 2));
+        options.mesh_points = std::min(options.mesh_points, 50);
+        options.streamline_dt *= 4.0;
+        solve = &job.coarse_solve;
+    } else if (pass == 1) {
+        options.mesh_points = std::max(2, options.mesh_points / 2);
+        options.streamline_dt *= 2.0;
+    }
+
+    return pack_analysis(analyze_airfoil_cached(
+        job.results[pass], *solve, nullptr, job.naca, job.u_fs, job.aoa_deg, n, job.n_streamlines, options));
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "panel_geometry.hpp"
+
+// timings and counters, filled when collect_stats is set; line_* have one
+// entry per seeded line
+struct AnalysisStats {
+    bool collected = false;
+    bool reused_solution = false;   // rescaled from the previous result
+    bool refactored = false;
+    double assemble_ms = 0.0;       // geometry and influence matrix
+    double factor_ms = 0.0;
+    double solve_ms = 0.0;          // including assembly and factorization
+    double field_ms = 0.0;
+    double streamline_ms = 0.0;     // includes lazy field evaluation
+    double total_ms = 0.0;
+    double solve_kernel_evals = 0.0;
+    double field_kernel_evals = 0.0;
+    int field_points = 0;
+    int masked_points = 0;
+    std::vector<int> line_steps;
+    std::vector<int> line_lookups;
+    std::vector<int> line_end;
+};
+
+inline void clear_stats(AnalysisStats& stats) {
+    std::vector<int> steps, lookups, end;
+    steps.swap(stats.line_steps);
+    lookups.swap(stats.line_lookups);
+    end.swap(stats.line_end);
+    stats = AnalysisStats();
+    steps.clear();
+    lookups.clear();
+    end.clear();
+    stats.line_steps.swap(steps);
+    stats.line_lookups.swap(lookups);
+    stats.line_end.swap(end);
+}
+
+// per-call switches; the defaults reproduce analyze_airfoil
+struct AnalysisOptions {
+    bool cache_field_influence = false;
+    int n_threads = 0;
+    // > 0 evaluates the field with the treecode at this tolerance
+    double far_field_tolerance = 0.0;
+    // dormand-prince streamlines instead of fixed-step RK4
+    bool adaptive_streamlines = false;
+    double streamline_tolerance = 1e-5;
+    // streamlines as stream function isolines; evaluates the field directly
+    bool contour_streamlines = false;
+    // field and streamlines in float; the solve stays in double
+    bool single_precision = false;
+    // evaluate only the points the seeded lines pass; NaN elsewhere
+    bool lazy_field = false;
+    int mesh_points = 200;
+    double streamline_dt = 1e-4;
+    bool batched_streamlines = true;
+    // Jobard-Lefer placement instead of edge seeds; fixed-step RK4 only
+    bool evenly_spaced_streamlines = false;
+    // 0 picks EVEN_DEFAULT_SEPARATION times the edge seed spacing
+    double streamline_separation = 0.0;
+    // > 0 thins lines with douglas-peucker at this distance
+    double simplify_tolerance = 0.0;
+    bool collect_stats = false;
+    // restarted GMRES instead of the cached factorization
+    bool iterative_solve = false;
+    // factor in float, refine in double; ignored with iterative_solve
+    bool mixed_precision_solve = false;
+    double solve_tolerance = 1e-12;            // relative residual of either
+    double solve_far_field_tolerance = 1e-9;
+    // compress the GMRES operator into an H-matrix instead
+    bool solve_hmatrix = false;
+};
+
+inline AnalysisOptions default_analysis_options() {
+    return AnalysisOptions();
+}
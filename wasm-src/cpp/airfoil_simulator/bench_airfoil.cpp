@@ -0,0 +1,660 @@
+// native stage-level benchmark for the panel solver
+//
+//   make native EIGEN=/usr/include/eigen3
+//   ./bench_airfoil [--naca 2412] [--aoa 5] [--ufs 15] [--reps 5]
+//                   [--panels 50,100,200,500,1000,2000] [--mesh 100,200,400]
+//                   [--streamlines 40] [--threads 0]
+//
+// min and median ms per stage plus a checksum; checks exit 1 on failure
+
+#include "analysis.hpp"
+#include "bench_support.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+int main(int argc, char** argv) {
+    BenchConfig cfg = parse_args(argc, argv);
+    double aoa = cfg.aoa_deg * M_PI / 180.0;
+
+    // same domain analyze_airfoil uses
+    double coeff = 2;
+    double domain[4] = {-0.2 * coeff, 1.2 * coeff, -0.7 * coeff, 0.7 * coeff};
+
+    std::printf("# naca %s  aoa %.3f deg  u_fs %.3f  reps %d  streamlines %d  threads %d\n",
+                cfg.naca.c_str(), cfg.aoa_deg, cfg.u_fs, cfg.reps, cfg.n_streamlines,
+                resolve_threads(cfg.threads));
+    std::printf("%-16s %6s %6s %12s %12s %18s\n", "# stage", "n", "mesh", "min_ms", "median_ms", "checksum");
+
+    for (int n : cfg.panels) {
+        MatrixXd coords;
+        auto t_gen = time_stage(cfg.reps, [&] { coords = panelgen(cfg.naca, n, aoa); });
+        report("panelgen", n, 0, t_gen, coords.sum());
+
+        MatrixXd A;
+        VectorXd B;
+        auto t_asm = time_stage(cfg.reps, [&] { build_system(coords, cfg.u_fs, n, aoa, A, B); });
+        report("assemble", n, 0, t_asm, A.sum());
+
+        VectorXd mu;
+        auto t_solve = time_stage(cfg.reps, [&] { mu = solve_system(coords, cfg.u_fs, n, aoa); });
+        double cl = -2.0 * mu(n) / cfg.u_fs;
+        report("solve_system", n, 0, t_solve, cl);
+
+        // AoA-only change against a warm cache: rank-1 update, no refactor
+        double aoa_alt = aoa + 2.0 * M_PI / 180.0;
+        BodySolveCache cache;
+        MatrixXd coords_alt;
+        solve_system_cached(cache, cfg.naca, n, cfg.u_fs, aoa, coords_alt);
+        int factorizations = cache.factorizations;
+        VectorXd mu_alt;
+        auto t_resolve = time_stage(cfg.reps, [&] {
+            mu_alt = solve_system_cached(cache, cfg.naca, n, cfg.u_fs, aoa_alt, coords_alt);
+        });
+        double cl_alt = -2.0 * mu_alt(n) / cfg.u_fs;
+        double cl_ref = -2.0 * solve_system(panelgen(cfg.naca, n, aoa_alt), cfg.u_fs, n, aoa_alt)(n) / cfg.u_fs;
+        report("resolve_aoa", n, 0, t_resolve, cl_alt);
+        std::printf("#   rank-1 vs fresh solve |dcl| = %.3e\n", std::abs(cl_alt - cl_ref));
+        if (cache.factorizations != factorizations || std::abs(cl_alt - cl_ref) > 1e-9 * std::abs(cl_ref)) {
+            std::fprintf(stderr, "resolve_aoa refactored or left the fresh solve at n=%d\n", n);
+            return 1;
+        }
+
+        // the treecode's truncation sets the tolerance here and for GMRES
+        const double cl_tolerance = 1e-7 * std::abs(cl);
+        IterativeSolveInfo mixed_info;
+        VectorXd mu_mixed;
+        auto t_mixed = time_stage(cfg.reps, [&] {
+            mu_mixed = solve_system_mixed(coords, cfg.u_fs, n, aoa, 1e-12, mixed_info);
+        });
+        double cl_mixed = -2.0 * mu_mixed(n) / cfg.u_fs;
+        report("solve_mixed", n, 0, t_mixed, cl_mixed);
+        std::printf("#   %d refinement steps, residual %.3e, |dcl| = %.3e\n", mixed_info.iterations,
+                    mixed_info.residual, std::abs(cl_mixed - cl));
+        if (std::abs(cl_mixed - cl) > cl_tolerance) {
+            std::fprintf(stderr, "mixed-precision cl differs from solve_system at n=%d\n", n);
+            return 1;
+        }
+
+        PanelOperator hmat_op;
+        auto t_hmat = time_stage(1, [&] { hmat_op = panel_operator(coords, n, 1e-9, cfg.threads, true); });
+        report("hmatrix_build", n, 0, t_hmat, hmatrix_bytes(hmat_op.hmatrix) / 1e6);
+        std::printf("#   %zu blocks, dense A would be %.3f MB\n", hmat_op.hmatrix.blocks.size(), 8e-6 * n * n);
+
+        // matrix-free GMRES with exact, treecode and H-matrix products
+        struct { const char* stage; double far_tol; bool hmatrix; } gmres_modes[] = {
+            {"solve_gmres", 0.0, false}, {"solve_gmres_tree", 1e-9, false}, {"solve_gmres_hmat", 1e-9, true}};
+        for (const auto& mode : gmres_modes) {
+            MatrixXd coords_it;
+            IterativeSolveInfo info;
+            VectorXd mu_it;
+            auto t_it = time_stage(cfg.reps, [&] {
+                mu_it = solve_system_iterative(cfg.naca, n, cfg.u_fs, aoa, 1e-12, mode.far_tol, mode.hmatrix,
+                                               cfg.threads, coords_it, info);
+            });
+            double cl_it = -2.0 * mu_it(n) / cfg.u_fs;
+            report(mode.stage, n, 0, t_it, cl_it);
+            std::printf("#   %d iterations, residual %.3e, |dcl| = %.3e\n", info.iterations, info.residual,
+                        std::abs(cl_it - cl));
+            if (!info.converged || std::abs(cl_it - cl) > cl_tolerance) {
+                std::fprintf(stderr, "gmres cl differs from solve_system at n=%d\n", n);
+                return 1;
+            }
+        }
+
+        // 101-point polar from -10 to 15 degrees
+        std::vector<double> alphas(101);
+        for (int k = 0; k < 101; ++k) alphas[k] = -10.0 + 0.25 * k;
+        VectorXd polar;
+        int polar_factorizations = 0;
+        auto t_polar = time_stage(cfg.reps, [&] {
+            BodySolveCache polar_cache;
+            polar = compute_polar_cached(polar_cache, cfg.naca, n, alphas);
+            polar_factorizations = polar_cache.factorizations;
+        });
+        report("polar_101", n, 0, t_polar, polar.sum());
+        // the same angles one solve_system each
+        VectorXd polar_plain(alphas.size());
+        auto t_polar_plain = time_stage(cfg.reps, [&] {
+            for (size_t k = 0; k < alphas.size(); ++k) {
+                double a = alphas[k] * M_PI / 180.0;
+                polar_plain(k) = -2.0 * solve_system(panelgen(cfg.naca, n, a), 1.0, n, a)(n);
+            }
+        });
+        report("polar_101_plain", n, 0, t_polar_plain, polar_plain.sum());
+        if (polar_factorizations != 1 || (polar - polar_plain).cwiseAbs().maxCoeff() > 1e-9) {
+            std::fprintf(stderr, "polar refactored or differs from one solve per angle at n=%d\n", n);
+            return 1;
+        }
+        // the js entry point hands back the same cl in one buffer
+        PolarResult packed_polar = compute_polar(cfg.naca, n, alphas);
+        if (!packed_polar.err.empty() || packed_polar.cl.size() != alphas.size() ||
+            (Map<const VectorXd>(packed_polar.cl.data(), packed_polar.cl.size()) - polar).cwiseAbs().maxCoeff() > 1e-9) {
+            std::fprintf(stderr, "compute_polar differs from compute_polar_cached at n=%d\n", n);
+            return 1;
+        }
+
+        for (int mesh : cfg.meshes) {
+            RegularGrid grid = create_mesh(domain[0], domain[1], domain[2], domain[3], mesh, mesh);
+
+            MatrixXd mesh_x(mesh, mesh), mesh_z(mesh, mesh);
+            for (int i = 0; i < mesh; ++i) {
+                for (int j = 0; j < mesh; ++j) {
+                    mesh_x(i, j) = grid.x(j);
+                    mesh_z(i, j) = grid.z(i);
+                }
+            }
+
+            MatrixXd body = coords.topRows(n);
+            Matrix<bool, Dynamic, Dynamic> mask_ref, mask;
+            auto t_poly = time_stage(cfg.reps, [&] { mask_ref = in_polygon(mesh_x, mesh_z, body); });
+            report("in_polygon", n, mesh, t_poly, mask_ref.count());
+            auto t_scan = time_stage(cfg.reps, [&] { mask = mesh_interior_mask(grid, body); });
+            report("scanline_mask", n, mesh, t_scan, mask.count());
+            if (mask != mask_ref) {
+                std::fprintf(stderr, "scanline mask differs from in_polygon at n=%d mesh=%d\n", n, mesh);
+                return 1;
+            }
+
+            // in the band when the mask changes within band points along row or column
+            const int band = 2;
+            Matrix<bool, Dynamic, Dynamic> near;
+            auto t_band = time_stage(cfg.reps, [&] { near = near_wall_band(mask, band); });
+            report("near_wall_band", n, mesh, t_band, near.count());
+            for (int i = 0; i < mask.rows(); ++i) {
+                for (int j = 0; j < mask.cols(); ++j) {
+                    bool varies = false;
+                    for (int k = std::max(0, j - band); k <= std::min<int>(mask.cols() - 1, j + band); ++k) {
+                        varies |= mask(i, k) != mask(i, j);
+                    }
+                    for (int k = std::max(0, i - band); k <= std::min<int>(mask.rows() - 1, i + band); ++k) {
+                        varies |= mask(k, j) != mask(i, j);
+                    }
+                    if (near(i, j) != varies) {
+                        std::fprintf(stderr, "near_wall_band differs from the brute-force band at n=%d mesh=%d\n",
+                                     n, mesh);
+                        return 1;
+                    }
+                }
+            }
+
+            VelocityField field;
+            auto t_vel = time_stage(cfg.reps, [&] {
+                field = calculate_velocity(grid, mu, coords, cfg.u_fs, aoa, n);
+            });
+            report("velocity", n, mesh, t_vel, field_checksum(field));
+
+            int threads = resolve_threads(cfg.threads);
+            VelocityField tiled;
+            auto t_tiled = time_stage(cfg.reps, [&] {
+                tiled = calculate_velocity_tiled(grid, mu, coords, cfg.u_fs, aoa, n, threads);
+            });
+            report("velocity_mt", n, mesh, t_tiled, threads);
+            bool same = tiled.u.size() == field.u.size() &&
+                        std::memcmp(tiled.u.data(), field.u.data(), field.u.size() * sizeof(double)) == 0 &&
+                        std::memcmp(tiled.v.data(), field.v.data(), field.v.size() * sizeof(double)) == 0;
+            if (!same) {
+                std::fprintf(stderr, "threaded field differs from serial at n=%d mesh=%d\n", n, mesh);
+                return 1;
+            }
+
+            // reference on the gauge-free strengths
+            VelocityField field_ref = calculate_velocity_tiled(
+                grid, remove_body_gauge(mu, n), coords, cfg.u_fs, aoa, n, threads);
+
+            VelocityFieldF field_f32;
+            auto t_f32 = time_stage(cfg.reps, [&] {
+                field_f32 = calculate_velocity_tiled_as<float>(grid, mu, coords, cfg.u_fs, aoa, n, threads, false);
+            });
+            VelocityField widened{field_f32.u.cast<double>(), field_f32.v.cast<double>(), MatrixXd()};
+            report("velocity_f32", n, mesh, t_f32, field_checksum(widened));
+            std::printf("#   float32 max |du| / u_fs = %.3e\n", max_field_error(widened, field_ref) / cfg.u_fs);
+
+            for (double tol : {1e-3, 1e-6}) {
+                VelocityField tree;
+                auto t_tree = time_stage(cfg.reps, [&] {
+                    tree = calculate_velocity_tree(grid, mu, coords, cfg.u_fs, aoa, n, tol, threads);
+                });
+                report(tol > 1e-4 ? "velocity_tree3" : "velocity_tree6", n, mesh, t_tree, field_checksum(tree));
+                std::printf("#   treecode max |du| / u_fs = %.3e\n", max_field_error(tree, field_ref) / cfg.u_fs);
+            }
+
+            VelocityField with_psi;
+            auto t_psi = time_stage(cfg.reps, [&] {
+                with_psi = calculate_velocity_tiled(grid, mu, coords, cfg.u_fs, aoa, n, threads, true);
+            });
+            report("velocity_psi", n, mesh, t_psi, field_checksum(with_psi));
+
+            std::vector<MatrixXd> contours;
+            auto t_contour = time_stage(cfg.reps, [&] {
+                contours = stream_function_contours(with_psi.psi, grid, cfg.n_streamlines);
+            });
+            double contour_sum = 0.0;
+            long contour_points = 0;
+            for (const MatrixXd& line : contours) {
+                contour_sum += line.sum();
+                contour_points += line.rows();
+            }
+            report("psi_contours", n, mesh, t_contour, contour_sum);
+            std::printf("#   %zu contour polylines, %ld points\n", contours.size(), contour_points);
+
+            FieldInfluenceCache field_cache;
+            auto t_build = time_stage(1, [&] { build_field_cache(field_cache, grid, coords, n); });
+            report("field_cache", n, mesh, t_build, field_cache_bytes(field_cache) / 1048576.0);
+
+            VelocityField cached;
+            auto t_cached = time_stage(cfg.reps, [&] {
+                cached = calculate_velocity_cached(field_cache, grid, mu, coords, cfg.u_fs, aoa, n);
+            });
+            report("velocity_gemv", n, mesh, t_cached, field_checksum(cached));
+
+            std::vector<MatrixXd> lines;
+            auto t_lines = time_stage(cfg.reps, [&] {
+                lines.clear();
+                for (int i = 0; i < cfg.n_streamlines; ++i) {
+                    double z0 = domain[2] + (domain[3] - domain[2]) * (i + 0.5) / cfg.n_streamlines;
+                    MatrixXd line = calculate_streamline(field, grid, domain[0], z0, 0.0001, 2000);
+                    if (line.rows() > 1) lines.push_back(line);
+                }
+            });
+            double line_sum = 0.0;
+            for (const MatrixXd& line : lines) line_sum += line.sum();
+            report("streamlines", n, mesh, t_lines, line_sum);
+
+            // same lines up to how the compiler contracts the RK arithmetic
+            AnalysisOptions line_options;
+            line_options.batched_streamlines = false;
+            std::vector<MatrixXd> lines_serial, lines_batch;
+            auto t_serial_lines = time_stage(cfg.reps, [&] {
+                lines_serial = seeded_streamlines<double>(GridSampler(field, grid), grid, cfg.u_fs, cfg.n_streamlines,
+                                                          line_options);
+            });
+            line_options.batched_streamlines = true;
+            StreamlineBatch<double> batch;
+            auto t_batch_lines = time_stage(cfg.reps, [&] {
+                lines_batch.clear();
+                std::vector<Vector2d> points;
+                trace_seeded_streamlines<double>(
+                    GridSampler(field, grid), grid, cfg.u_fs, cfg.n_streamlines, line_options,
+                    [&]() { points.clear(); },
+                    [&](double x, double z) { points.push_back(Vector2d(x, z)); },
+                    [&]() { if (points.size() > 1) lines_batch.push_back(points_to_matrix(points)); },
+                    nullptr, &batch);
+            });
+            double serial_sum = 0.0, batch_sum = 0.0, batch_err = 0.0;
+            for (const MatrixXd& line : lines_serial) serial_sum += line.sum();
+            for (const MatrixXd& line : lines_batch) batch_sum += line.sum();
+            bool same_shape = lines_serial.size() == lines_batch.size();
+            for (size_t k = 0; same_shape && k < lines_serial.size(); ++k) {
+                same_shape = lines_serial[k].rows() == lines_batch[k].rows();
+                if (same_shape) batch_err = std::max(batch_err, (lines_serial[k] - lines_batch[k]).cwiseAbs().maxCoeff());
+            }
+            report("streamlines_seed", n, mesh, t_serial_lines, serial_sum);
+            report("streamlines_batch", n, mesh, t_batch_lines, batch_sum);
+            std::printf("#   batched vs one seed at a time: max point difference %.3e\n", batch_err);
+            if (!same_shape || batch_err > 1e-9) {
+                std::fprintf(stderr, "batched streamlines differ from the per-seed ones at n=%d mesh=%d\n", n, mesh);
+                return 1;
+            }
+
+            // Jobard-Lefer must leave no more uncovered in no more steps than edge seeds
+            AnalysisOptions even_options;
+            even_options.evenly_spaced_streamlines = true;
+            AnalysisStats edge_stats, even_stats;
+            std::vector<MatrixXd> lines_even;
+            auto t_even = time_stage(cfg.reps, [&] {
+                clear_stats(even_stats);
+                lines_even = seeded_streamlines<double>(GridSampler(field, grid), grid, cfg.u_fs, cfg.n_streamlines,
+                                                        even_options, &even_stats);
+            });
+            seeded_streamlines<double>(GridSampler(field, grid), grid, cfg.u_fs, cfg.n_streamlines, line_options,
+                                       &edge_stats);
+            double even_sum = 0.0;
+            for (const MatrixXd& line : lines_even) even_sum += line.sum();
+            report("streamlines_even", n, mesh, t_even, even_sum);
+            double d_sep = (domain[3] - domain[2]) / cfg.n_streamlines;
+            double gap_edge = uncovered_fraction(field, grid, lines_batch, d_sep);
+            double gap_even = uncovered_fraction(field, grid, lines_even, d_sep);
+            long steps_edge = 0, steps_even = 0;
+            for (int s : edge_stats.line_steps) steps_edge += s;
+            for (int s : even_stats.line_steps) steps_even += s;
+            std::printf("#   edge seeds: %zu lines %ld steps %.1f%% uncovered; evenly spaced: %zu lines %ld steps "
+                        "%.1f%% uncovered\n",
+                        lines_batch.size(), steps_edge, 100.0 * gap_edge, lines_even.size(), steps_even,
+                        100.0 * gap_even);
+            if (gap_even > gap_edge || steps_even > steps_edge) {
+                std::fprintf(stderr, "evenly spaced streamlines cover less or step more than the edge seeds at "
+                             "n=%d mesh=%d\n", n, mesh);
+                return 1;
+            }
+
+            // half a pixel of a 600 px plot; every traced point within tolerance
+            line_options.simplify_tolerance = 0.5 * 1.4 / 600;
+            std::vector<MatrixXd> lines_simple;
+            auto t_simple = time_stage(cfg.reps, [&] {
+                lines_simple = seeded_streamlines<double>(GridSampler(field, grid), grid, cfg.u_fs,
+                                                          cfg.n_streamlines, line_options);
+            });
+            line_options.simplify_tolerance = 0.0;
+            double simple_sum = 0.0, simple_err = 0.0;
+            long points_traced = 0, points_kept = 0;
+            bool simple_shape = lines_simple.size() == lines_batch.size();
+            for (size_t k = 0; simple_shape && k < lines_batch.size(); ++k) {
+                const MatrixXd& full = lines_batch[k];
+                const MatrixXd& kept = lines_simple[k];
+                simple_sum += kept.sum();
+                points_traced += full.rows();
+                points_kept += kept.rows();
+                Index seg = 0;
+                for (Index p = 0; p < full.rows() && simple_shape; ++p) {
+                    if (seg + 1 < kept.rows() && full.row(p) == kept.row(seg + 1)) ++seg;
+                    if (seg + 1 >= kept.rows()) {
+                        simple_shape = full.row(p) == kept.row(seg) && p + 1 == full.rows();
+                        break;
+                    }
+                    Vector2d a = kept.row(seg).transpose(), e = kept.row(seg + 1).transpose() - a;
+                    Vector2d q = full.row(p).transpose() - a;
+                    double t = std::min(std::max(q.dot(e) / e.squaredNorm(), 0.0), 1.0);
+                    simple_err = std::max(simple_err, (q - t * e).norm());
+                }
+            }
+            report("streamlines_dp", n, mesh, t_simple, simple_sum);
+            std::printf("#   douglas-peucker kept %ld of %ld points (%.1fx fewer), max deviation %.3e\n",
+                        points_kept, points_traced, double(points_traced) / std::max(points_kept, 1L), simple_err);
+            if (!simple_shape || simple_err > 0.5 * 1.4 / 600) {
+                std::fprintf(stderr, "simplified streamlines leave the tolerance at n=%d mesh=%d\n", n, mesh);
+                return 1;
+            }
+
+            // lazily evaluated field; the time includes the points it needs
+            LazyVelocityField lazy;
+            std::vector<MatrixXd> lines_lazy;
+            auto t_lazy = time_stage(cfg.reps, [&] {
+                lazy = lazy_velocity_field(grid, mu, coords, cfg.u_fs, aoa, n);
+                LazyGridSampler sampler(lazy);
+                lines_lazy.clear();
+                for (int i = 0; i < cfg.n_streamlines; ++i) {
+                    double z0 = domain[2] + (domain[3] - domain[2]) * (i + 0.5) / cfg.n_streamlines;
+                    MatrixXd line = integrate_streamline_rk4<double>(sampler, domain[0], z0, 0.0001, 2000);
+                    if (line.rows() > 1) lines_lazy.push_back(line);
+                }
+            });
+            double line_sum_lazy = 0.0;
+            for (const MatrixXd& line : lines_lazy) line_sum_lazy += line.sum();
+            report("streamlines_lazy", n, mesh, t_lazy, line_sum_lazy);
+            std::printf("#   lazy field evaluated %ld of %ld points\n", lazy.evaluated, long(mesh) * mesh);
+            if (line_sum_lazy != line_sum) {
+                std::fprintf(stderr, "lazy-field streamlines differ from the full field at n=%d mesh=%d\n", n, mesh);
+                return 1;
+            }
+
+            std::vector<MatrixXd> lines_f32;
+            auto t_lines_f32 = time_stage(cfg.reps, [&] {
+                lines_f32.clear();
+                for (int i = 0; i < cfg.n_streamlines; ++i) {
+                    double z0 = domain[2] + (domain[3] - domain[2]) * (i + 0.5) / cfg.n_streamlines;
+                    MatrixXd line = calculate_streamline_as(field_f32, grid, domain[0], z0, 0.0001, 2000);
+                    if (line.rows() > 1) lines_f32.push_back(line);
+                }
+            });
+            double line_sum_f32 = 0.0;
+            for (const MatrixXd& line : lines_f32) line_sum_f32 += line.sum();
+            report("streamlines_f32", n, mesh, t_lines_f32, line_sum_f32);
+            // both integrate the same number of steps, so endpoints line up
+            double end_err = 0.0;
+            for (size_t k = 0; k < std::min(lines.size(), lines_f32.size()); ++k) {
+                Index last = std::min(lines[k].rows(), lines_f32[k].rows()) - 1;
+                end_err = std::max(end_err, (lines[k].row(last) - lines_f32[k].row(last)).norm());
+            }
+            std::printf("#   float32 streamline endpoint drift %.3e\n", end_err);
+
+            // dormand-prince with the same reach as the fixed-step lines
+            AdaptiveStreamlineSettings adaptive;
+            adaptive.max_length = 0.0001 * 2000 * cfg.u_fs;
+            adaptive.h_edge = (domain[1] - domain[0]) / (mesh - 1);
+            adaptive.h_max = 8.0 * adaptive.h_edge;
+            GridSampler sampler(field, grid);
+            long evals_rk45 = 0, points_rk45 = 0;
+            auto t_rk45 = time_stage(cfg.reps, [&] {
+                lines.clear();
+                evals_rk45 = points_rk45 = 0;
+                for (int i = 0; i < cfg.n_streamlines; ++i) {
+                    double z0 = domain[2] + (domain[3] - domain[2]) * (i + 0.5) / cfg.n_streamlines;
+                    int evals = 0;
+                    MatrixXd line = integrate_streamline_adaptive(sampler, domain[0], z0, adaptive, &evals);
+                    evals_rk45 += evals;
+                    points_rk45 += line.rows();
+                    if (line.rows() > 1) lines.push_back(line);
+                }
+            });
+            line_sum = 0.0;
+            for (const MatrixXd& line : lines) line_sum += line.sum();
+            report("streamlines_rk45", n, mesh, t_rk45, line_sum);
+            std::printf("#   rk45 lookups/line %.1f points/line %.1f\n",
+                        double(evals_rk45) / cfg.n_streamlines, double(points_rk45) / cfg.n_streamlines);
+        }
+
+        PanelAnalysis res;
+        int rep = 0;
+        auto t_total = time_stage(cfg.reps, [&] {
+            double aoa_deg = cfg.aoa_deg + 0.01 * (++rep);
+            res = analyze_airfoil(cfg.naca, cfg.u_fs, aoa_deg, n, cfg.n_streamlines);
+        });
+        res = analyze_airfoil(cfg.naca, cfg.u_fs, cfg.aoa_deg, n, cfg.n_streamlines);
+        if (!res.err.empty()) {
+            std::fprintf(stderr, "analyze_airfoil failed: %s\n", res.err.c_str());
+            return 1;
+        }
+        report("analyze_airfoil", n, 200, t_total, res.cl);
+
+        // counters describe the returned lines; output matches an uninstrumented run
+        {
+            AnalysisOptions stats_options = default_analysis_options();
+            stats_options.collect_stats = true;
+            double aoa_deg = cfg.aoa_deg + 0.01 * (++rep);
+            PanelAnalysis timed = analyze_airfoil_with(cfg.naca, cfg.u_fs, aoa_deg, n, cfg.n_streamlines, stats_options);
+            const AnalysisStats& st = timed.stats;
+            long points = 0, kept_steps = 0, lookups = 0;
+            int ends[6] = {};
+            for (const MatrixXd& line : timed.streamlines) points += line.rows();
+            for (size_t k = 0; k < st.line_steps.size(); ++k) {
+                if (st.line_steps[k] > 1) kept_steps += st.line_steps[k];
+                lookups += st.line_lookups[k];
+                ++ends[st.line_end[k]];
+            }
+            PanelAnalysis plain = analyze_airfoil_with(cfg.naca, cfg.u_fs, aoa_deg + 1e-9, n, cfg.n_streamlines,
+                                                       default_analysis_options());
+            if (!st.collected || int(st.line_steps.size()) != cfg.n_streamlines || kept_steps != points ||
+                std::abs(timed.cl - plain.cl) > 1e-6 || timed.streamlines.size() != plain.streamlines.size()) {
+                std::fprintf(stderr, "analysis stats inconsistent with the result at n=%d\n", n);
+                return 1;
+            }
+            std::printf("#   stats solve %.2f ms (assemble %.2f factor %.2f%s) field %.2f ms streamlines %.2f ms"
+                        " total %.2f ms\n", st.solve_ms, st.assemble_ms, st.factor_ms,
+                        st.refactored ? ", refactored" : "", st.field_ms, st.streamline_ms, st.total_ms);
+            std::printf("#   stats kernels solve %.0f field %.0f, masked %d/%d, steps %ld lookups %ld,"
+                        " ends steps %d length %d outside %d body %d stagnant %d min_step %d\n",
+                        st.solve_kernel_evals, st.field_kernel_evals, st.masked_points, st.field_points,
+                        kept_steps, lookups, ends[END_MAX_STEPS], ends[END_MAX_LENGTH], ends[END_OUTSIDE],
+                        ends[END_MASKED], ends[END_STAGNATION], ends[END_MIN_STEP]);
+        }
+
+        // new angle is a rank-1 update, new u_fs a rescale; both match analyze_airfoil
+        {
+            AnalysisOptions cache_options = default_analysis_options();
+            cache_options.collect_stats = true;
+            AnalysisCache cache;
+            cache_analyze(cache, cfg.naca, cfg.u_fs, cfg.aoa_deg, n, cfg.n_streamlines, cache_options);
+            double aoa_deg = cfg.aoa_deg + 0.01 * (++rep);
+            PanelAnalysis moved;
+            auto t_cache = time_stage(1, [&] {
+                moved = cache_analyze(cache, cfg.naca, cfg.u_fs, aoa_deg, n, cfg.n_streamlines, cache_options);
+            });
+            PanelAnalysis rescaled = cache_analyze(cache, cfg.naca, 2.0 * cfg.u_fs, aoa_deg, n, cfg.n_streamlines,
+                                                   cache_options);
+            PanelAnalysis direct = analyze_airfoil(cfg.naca, cfg.u_fs, aoa_deg, n, cfg.n_streamlines);
+            if (!moved.err.empty() || moved.stats.refactored || !rescaled.stats.reused_solution ||
+                std::abs(moved.cl - direct.cl) > 1e-9 * std::abs(direct.cl) ||
+                std::abs(rescaled.cl - direct.cl) > 1e-9 * std::abs(direct.cl)) {
+                std::fprintf(stderr, "analysis cache refactored or differs from analyze_airfoil at n=%d\n", n);
+                return 1;
+            }
+            report("analysis_cache_aoa", n, 200, t_cache, moved.cl);
+
+            // operator stays under the cap and release frees it
+            AnalysisOptions field_options = default_analysis_options();
+            field_options.cache_field_influence = true;
+            double field_aoa = cfg.aoa_deg + 0.01 * (++rep);
+            PanelAnalysis cached = cache_analyze(cache, cfg.naca, cfg.u_fs, field_aoa, n, cfg.n_streamlines,
+                                                 field_options);
+            PanelAnalysis field_direct = analyze_airfoil(cfg.naca, cfg.u_fs, field_aoa, n, cfg.n_streamlines);
+            size_t field_bytes = field_cache_bytes(cache.field);
+            bool fits = field_cache_fits(cache.field, cached.stream_grid, n);
+            cache_release(cache);
+            if (!cached.err.empty() || field_bytes > cache.field.max_bytes || fits != (field_bytes > 0) ||
+                field_cache_bytes(cache.field) != 0 || cache.solve.factorizations != 0 ||
+                std::abs(cached.cl - field_direct.cl) > 1e-9 * std::abs(field_direct.cl)) {
+                std::fprintf(stderr, "field cache over its cap or not released at n=%d\n", n);
+                return 1;
+            }
+            std::printf("#   field cache %.1f MB of %.0f MB cap%s, released\n", field_bytes / 1048576.0,
+                        cache.field.max_bytes / 1048576.0, fits ? "" : " (skipped)");
+        }
+
+        PackedAnalysis packed;
+        auto t_pack = time_stage(cfg.reps, [&] { packed = pack_analysis(res); });
+        report("pack_result", n, 200, t_pack, packed.data.size() * sizeof(float) / 1024.0);
+
+        // last pass matches analyze_airfoil; a restart refactors neither level
+        std::vector<double> pass_times[PROGRESSIVE_PASSES];
+        double pass_cl[PROGRESSIVE_PASSES] = {};
+        PackedAnalysis last_pass;
+        ProgressiveAnalysis job(cfg.naca, cfg.u_fs, cfg.aoa_deg, n, cfg.n_streamlines, default_analysis_options());
+        for (int r = 1; r <= cfg.reps + 1; ++r) {
+            double aoa_deg = cfg.aoa_deg + 0.01 * (++rep);
+            progressive_restart(job, cfg.naca, cfg.u_fs, aoa_deg, n, cfg.n_streamlines, default_analysis_options());
+            while (!progressive_done(job)) {
+                int pass = progressive_pass_index(job);
+                auto t0 = std::chrono::steady_clock::now();
+                last_pass = progressive_pass(job);
+                auto t1 = std::chrono::steady_clock::now();
+                pass_times[pass].push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+                pass_cl[pass] = last_pass.cl;
+            }
+            PanelAnalysis direct = analyze_airfoil(cfg.naca, cfg.u_fs, aoa_deg, n, cfg.n_streamlines);
+            if (!last_pass.err.empty() || std::abs(last_pass.cl - direct.cl) > 1e-9) {
+                std::fprintf(stderr, "progressive final pass differs from analyze_airfoil at n=%d\n", n);
+                return 1;
+            }
+        }
+        if (job.coarse_solve.factorizations != 1 || job.full_solve.factorizations != 1) {
+            std::fprintf(stderr, "progressive restart refactored at n=%d\n", n);
+            return 1;
+        }
+        for (int pass = 0; pass < PROGRESSIVE_PASSES; ++pass) {
+            std::vector<double>& t = pass_times[pass];
+            std::sort(t.begin(), t.end());
+            char stage[32];
+            std::snprintf(stage, sizeof(stage), "progressive_p%d", pass);
+            report(stage, n, pass == 0 ? 50 : pass == 1 ? 100 : 200, {t.front(), t[t.size() / 2]}, pass_cl[pass]);
+        }
+
+        // warm AoA changes through one workspace must not touch the heap
+        for (int ws_threads : {1, 0, 4}) {
+            AirfoilWorkspace ws;
+            AnalysisOptions ws_options = default_analysis_options();
+            ws_options.n_threads = ws_threads;
+            // warm-up: reference solve, then an angle change to size the update scratch
+            analyze_airfoil_into(ws, cfg.naca, cfg.u_fs, cfg.aoa_deg, n, cfg.n_streamlines, ws_options);
+            analyze_airfoil_into(ws, cfg.naca, cfg.u_fs, cfg.aoa_deg + 0.005, n, cfg.n_streamlines, ws_options);
+            long ws_allocations = 0;
+            auto t_ws = time_stage(cfg.reps, [&] {
+                double aoa_deg = cfg.aoa_deg + 0.01 * (++rep);
+                long before = allocation_count();
+                analyze_airfoil_into(ws, cfg.naca, cfg.u_fs, aoa_deg, n, cfg.n_streamlines, ws_options);
+                ws_allocations += allocation_count() - before;
+            });
+            analyze_airfoil_into(ws, cfg.naca, cfg.u_fs, cfg.aoa_deg, n, cfg.n_streamlines, ws_options);
+            // the two caches take different update paths; agree to roundoff
+            if (!ws.packed.err.empty() || std::abs(ws.packed.cl - res.cl) > 1e-9 ||
+                ws.packed.offsets.size() != pack_analysis(res).offsets.size()) {
+                std::fprintf(stderr, "workspace result differs from analyze_airfoil at n=%d\n", n);
+                return 1;
+            }
+            char stage[32] = "workspace";
+            if (ws_threads > 0) std::snprintf(stage, sizeof(stage), "workspace_t%d", ws_threads);
+            report(stage, n, 200, t_ws, ws.packed.cl);
+            std::printf("#   workspace allocations %ld high water %.2f MB%s\n", ws_allocations,
+                        ws.high_water_bytes / (1024.0 * 1024.0), g_counting_allocations ? "" : " (not counted)");
+            if (ws_allocations > 0) {
+                std::fprintf(stderr, "workspace allocated after warm-up at n=%d threads=%d\n", n, ws_threads);
+                return 1;
+            }
+        }
+
+        // u_fs-only changes against the result cache: no re-solve, no field
+        int flip = 0;
+        auto t_rescale = time_stage(cfg.reps, [&] {
+            double u = (flip++ % 2) ? cfg.u_fs : 1.5 * cfg.u_fs;
+            res = analyze_airfoil(cfg.naca, u, cfg.aoa_deg, n, cfg.n_streamlines);
+        });
+        report("rescale_ufs", n, 200, t_rescale, res.cl);
+
+        // 16 codes at 3 angles: one solve_system per job against the batch
+        std::vector<BatchJob> jobs;
+        for (int code = 0; code < 16; ++code) {
+            char naca[8];
+            std::snprintf(naca, sizeof(naca), "%d%d%02d", code % 4, 2 + code % 3, 9 + code);
+            for (double a : {0.0, 4.0, 8.0}) jobs.push_back({naca, a, n});
+        }
+        std::vector<double> serial_cl(jobs.size());
+        auto t_serial = time_stage(cfg.reps, [&] {
+            for (size_t j = 0; j < jobs.size(); ++j) {
+                double a = jobs[j].aoa_deg * M_PI / 180.0;
+                MatrixXd c = panelgen(jobs[j].naca, n, a);
+                serial_cl[j] = -2.0 * solve_system(c, cfg.u_fs, n, a)(n) / cfg.u_fs;
+            }
+        });
+        double serial_sum = 0.0;
+        for (double c : serial_cl) serial_sum += c;
+        report("batch_serial", n, 0, t_serial, serial_sum);
+
+        BatchOptions batch_options;
+        batch_options.with_mu = true;
+        batch_options.n_threads = cfg.threads;
+        BatchResult batch;
+        auto t_batch = time_stage(cfg.reps, [&] { batch = analyze_batch(jobs, cfg.u_fs, batch_options); });
+        double batch_sum = 0.0;
+        for (size_t j = 0; j < jobs.size(); ++j) {
+            if (!batch.err[j].empty() || std::abs(batch.cl[j] - serial_cl[j]) > 1e-9) {
+                std::fprintf(stderr, "batch cl differs from solve_system for %s at n=%d\n", jobs[j].naca.c_str(), n);
+                return 1;
+            }
+            batch_sum += batch.cl[j];
+        }
+        report("batch_cl", n, 0, t_batch, batch_sum);
+
+        // two concurrent batches; the one finding the pool busy runs serially
+        {
+            BatchWorkspace ws_a, ws_b;
+            BatchResult res_a, res_b;
+            long serial_before = thread_pool_serial_runs();
+            std::thread other([&] { res_b = analyze_batch_into(ws_b, jobs, cfg.u_fs, batch_options); });
+            res_a = analyze_batch_into(ws_a, jobs, cfg.u_fs, batch_options);
+            other.join();
+            std::printf("#   concurrent batches: %ld parallel_for calls found the pool busy and ran serially\n",
+                        thread_pool_serial_runs() - serial_before);
+            for (size_t j = 0; j < jobs.size(); ++j) {
+                if (!res_a.err[j].empty() || !res_b.err[j].empty() || res_a.cl[j] != batch.cl[j] ||
+                    res_b.cl[j] != batch.cl[j]) {
+                    std::fprintf(stderr, "concurrent batches differ for %s at n=%d\n", jobs[j].naca.c_str(), n);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+// timing, reporting and allocation counting for bench_airfoil only
+
+#include "analysis.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// counts heap allocations by wrapping glibc's malloc family
+#ifdef __GLIBC__
+#include <atomic>
+
+static std::atomic<long> g_allocations{0};
+static const bool g_counting_allocations = true;
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+
+void* malloc(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+
+static long allocation_count() { return g_allocations.load(); }
+#else
+static const bool g_counting_allocations = false;
+static long allocation_count() { return 0; }
+#endif
+
+namespace {
+
+struct BenchConfig {
+    std::string naca = "2412";
+    double aoa_deg = 5.0;
+    double u_fs = 15.0;
+    int reps = 5;
+    int n_streamlines = 40;
+    int threads = 0;
+    std::vector<int> panels = {50, 100, 200, 500, 1000, 2000};
+    std::vector<int> meshes = {100, 200, 400};
+};
+
+std::vector<int> parse_list(const char* arg) {
+    std::vector<int> out;
+    std::string s(arg);
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t next = s.find(',', pos);
+        if (next == std::string::npos) next = s.size();
+        out.push_back(std::stoi(s.substr(pos, next - pos)));
+        pos = next + 1;
+    }
+    return out;
+}
+
+BenchConfig parse_args(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::fprintf(stderr, "missing value for %s\n", argv[i]);
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+
+        if (!std::strcmp(argv[i], "--naca")) cfg.naca = next();
+        else if (!std::strcmp(argv[i], "--aoa")) cfg.aoa_deg = std::atof(next());
+        else if (!std::strcmp(argv[i], "--ufs")) cfg.u_fs = std::atof(next());
+        else if (!std::strcmp(argv[i], "--reps")) cfg.reps = std::max(1, std::atoi(next()));
+        else if (!std::strcmp(argv[i], "--streamlines")) cfg.n_streamlines = std::atoi(next());
+        else if (!std::strcmp(argv[i], "--threads")) cfg.threads = std::atoi(next());
+        else if (!std::strcmp(argv[i], "--panels")) cfg.panels = parse_list(next());
+        else if (!std::strcmp(argv[i], "--mesh")) cfg.meshes = parse_list(next());
+        else {
+            std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+            std::exit(2);
+        }
+    }
+    return cfg;
+}
+
+// runs fn reps times and returns {min, median} in milliseconds
+std::pair<double, double> time_stage(int reps, const std::function<void()>& fn) {
+    std::vector<double> ms(reps);
+    for (int r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        ms[r] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    }
+    std::sort(ms.begin(), ms.end());
+    return {ms.front(), ms[reps / 2]};
+}
+
+void report(const char* stage, int n, int mesh, std::pair<double, double> t, double checksum) {
+    std::printf("%-16s %6d %6d %12.3f %12.3f %18.10e\n", stage, n, mesh, t.first, t.second, checksum);
+    std::fflush(stdout);
+}
+
+double field_checksum(const VelocityField& field) {
+    double sum = 0.0;
+    for (Index i = 0; i < field.u.size(); ++i) {
+        if (!std::isnan(field.u(i))) sum += field.u(i) + field.v(i);
+    }
+    return sum;
+}
+
+double max_field_error(const VelocityField& a, const VelocityField& b) {
+    double err = 0.0;
+    for (Index i = 0; i < a.u.size(); ++i) {
+        if (std::isnan(b.u(i))) continue;
+        err = std::max(err, std::hypot(a.u(i) - b.u(i), a.v(i) - b.v(i)));
+    }
+    return err;
+}
+
+// share of open grid points with no line point within radius
+double uncovered_fraction(const VelocityField& field, const RegularGrid& grid,
+                          const std::vector<MatrixXd>& lines, double radius) {
+    SeparationHash hash;
+    separation_hash_reset(hash, grid, radius);
+    for (const MatrixXd& line : lines) {
+        for (Index p = 0; p < line.rows(); ++p) separation_hash_insert(hash, line(p, 0), line(p, 1));
+    }
+    long open = 0, uncovered = 0;
+    for (int j = 0; j < grid.nx; ++j) {
+        for (int i = 0; i < grid.nz; ++i) {
+            if (std::isnan(field.u(i, j))) continue;
+            ++open;
+            uncovered += !separation_hash_near(hash, grid.x(j), grid.z(i), radius);
+        }
+    }
+    return open ? double(uncovered) / open : 0.0;
+}
+
+} // namespace
@@ -0,0 +1,533 @@
+#pragma once
+
+#include "panel_solver.hpp"
+#include "velocity_field.hpp"
+
+// matrix-free influence system for GMRES: products in O(n^2) time and O(n)
+// memory (treecode when tolerance > 0), block-jacobi style preconditioner
+// over runs of GMRES_BLOCK panels
+const int GMRES_BLOCK = 128;
+const int GMRES_OVERLAP = 16;
+const int GMRES_RESTART = 60;
+const int GMRES_MAX_ITERATIONS = 1000;
+
+// H-matrix of the body block of A: well-separated index ranges are stored
+// as low-rank u v^T from adaptive cross approximation, the rest as dense
+// leaves; O(n log n) storage and products
+const int HMATRIX_LEAF = 32;
+const double HMATRIX_ETA = 1.0;   // admissible when min diameter <= eta * distance
+
+struct HMatrixBlock {
+    int row0, rows;
+    int col0, cols;
+    bool low_rank;
+    MatrixXd u, v;   // u v^T, or the dense block in u
+};
+
+struct HMatrix {
+    std::vector<HMatrixBlock> blocks;
+    size_t entries = 0;   // stored doubles
+};
+
+struct PanelOperator {
+    int n = 0;
+    PanelFrames f;            // n body panels and the wake
+    Collocation colloc;
+    bool use_tree = false;
+    PanelTree tree;
+    std::vector<std::vector<int>> block_panels;
+    int overlap = 0;
+    std::vector<PartialPivLU<MatrixXd>> blocks;
+    bool use_hmatrix = false;
+    HMatrix hmatrix;
+    std::unique_ptr<SparseLU<SparseMatrix<double>>> near_lu;
+    std::vector<VectorXd> hmatrix_partial;   // hmatrix_apply's per-thread sums
+    // A e for the uniform body doublet e
+    VectorXd gauge_image;
+    bool gauge_fixed = false;
+    int n_threads = 1;
+    double kernel_evals = 0.0;
+};
+
+// normal velocity at collocation point i from a unit doublet on panel j
+inline double panel_influence(const PanelOperator& op, int i, int j) {
+    const PanelFrames& f = op.f;
+    const Collocation& c = op.colloc;
+    double u, v;
+    doublet_unit_velocity(c.mid_x(i), c.mid_z(i), f.x1(j), f.z1(j), f.x2(j), f.z2(j),
+                          f.cos_a(j), f.sin_a(j), u, v);
+    return v * c.cos_beta(i) - u * c.sin_beta(i);
+}
+
+struct PanelBox {
+    double x0, x1, z0, z1;
+};
+
+inline PanelBox hmatrix_row_box(const PanelOperator& op, int r0, int r1) {
+    const Collocation& c = op.colloc;
+    PanelBox box{c.mid_x(r0), c.mid_x(r0), c.mid_z(r0), c.mid_z(r0)};
+    for (int i = r0 + 1; i < r1; ++i) {
+        box.x0 = std::min(box.x0, c.mid_x(i));
+        box.x1 = std::max(box.x1, c.mid_x(i));
+        box.z0 = std::min(box.z0, c.mid_z(i));
+        box.z1 = std::max(box.z1, c.mid_z(i));
+    }
+    return box;
+}
+
+inline PanelBox hmatrix_col_box(const PanelOperator& op, int c0, int c1) {
+    const PanelFrames& f = op.f;
+    PanelBox box{f.x2(c1 - 1), f.x2(c1 - 1), f.z2(c1 - 1), f.z2(c1 - 1)};
+    for (int j = c0; j < c1; ++j) {
+        box.x0 = std::min(box.x0, f.x1(j));
+        box.x1 = std::max(box.x1, f.x1(j));
+        box.z0 = std::min(box.z0, f.z1(j));
+        box.z1 = std::max(box.z1, f.z1(j));
+    }
+    return box;
+}
+
+inline bool hmatrix_admissible(const PanelBox& a, const PanelBox& b) {
+    double dx = std::max(0.0, std::max(a.x0 - b.x1, b.x0 - a.x1));
+    double dz = std::max(0.0, std::max(a.z0 - b.z1, b.z0 - a.z1));
+    double dist = std::hypot(dx, dz);
+    double diam = std::min(std::hypot(a.x1 - a.x0, a.z1 - a.z0), std::hypot(b.x1 - b.x0, b.z1 - b.z0));
+    return dist > 0.0 && diam <= HMATRIX_ETA * dist;
+}
+
+// partially pivoted ACA; false when it needs more storage than the block
+inline bool hmatrix_aca(const PanelOperator& op, HMatrixBlock& b, double tolerance, double& kernel_evals) {
+    int max_rank = b.rows * b.cols / (b.rows + b.cols);
+    std::vector<VectorXd> us, vs;
+    std::vector<bool> used(b.rows, false);
+    VectorXd row(b.cols), col(b.rows);
+    double norm_sq = 0.0;
+    int pivot = 0;
+    bool converged = false;
+
+    while ((int)us.size() < max_rank) {
+        used[pivot] = true;
+        for (int j = 0; j < b.cols; ++j) row(j) = panel_influence(op, b.row0 + pivot, b.col0 + j);
+        kernel_evals += b.cols;
+        for (size_t k = 0; k < us.size(); ++k) row -= us[k](pivot) * vs[k];
+
+        Index j_star;
+        double peak = row.cwiseAbs().maxCoeff(&j_star);
+        if (peak > 0.0) {
+            row /= row(j_star);
+            for (int i = 0; i < b.rows; ++i) col(i) = panel_influence(op, b.row0 + i, b.col0 + j_star);
+            kernel_evals += b.rows;
+            for (size_t k = 0; k < us.size(); ++k) col -= vs[k](j_star) * us[k];
+
+            double term_sq = col.squaredNorm() * row.squaredNorm();
+            for (size_t k = 0; k < us.size(); ++k) norm_sq += 2.0 * us[k].dot(col) * vs[k].dot(row);
+            norm_sq += term_sq;
+            us.push_back(col);
+            vs.push_back(row);
+            if (term_sq <= tolerance * tolerance * norm_sq) {
+                converged = true;
+                break;
+            }
+        }
+
+        int next = -1;
+        double best = -1.0;
+        for (int i = 0; i < b.rows; ++i) {
+            double mag = peak > 0.0 ? std::abs(col(i)) : 0.0;
+            if (!used[i] && mag > best) {
+                best = mag;
+                next = i;
+            }
+        }
+        if (next < 0) {
+            converged = true;
+            break;
+        }
+        pivot = next;
+    }
+    if (!converged) return false;
+
+    int rank = us.size();
+    b.low_rank = true;
+    b.u.resize(b.rows, rank);
+    b.v.resize(b.cols, rank);
+    for (int k = 0; k < rank; ++k) {
+        b.u.col(k) = us[k];
+        b.v.col(k) = vs[k];
+    }
+    return true;
+}
+
+inline void hmatrix_build(
+    HMatrix& h, const PanelOperator& op, int r0, int r1, int c0, int c1, double tolerance, double& kernel_evals) {
+
+    HMatrixBlock b{r0, r1 - r0, c0, c1 - c0, false, MatrixXd(), MatrixXd()};
+    if (hmatrix_admissible(hmatrix_row_box(op, r0, r1), hmatrix_col_box(op, c0, c1)) &&
+        hmatrix_aca(op, b, tolerance, kernel_evals)) {
+        h.entries += b.u.size() + b.v.size();
+        h.blocks.push_back(std::move(b));
+        return;
+    }
+    if (b.rows <= HMATRIX_LEAF || b.cols <= HMATRIX_LEAF) {
+        b.u.resize(b.rows, b.cols);
+        for (int j = 0; j < b.cols; ++j) {
+            for (int i = 0; i < b.rows; ++i) b.u(i, j) = panel_influence(op, r0 + i, c0 + j);
+        }
+        kernel_evals += double(b.rows) * b.cols;
+        h.entries += b.u.size();
+        h.blocks.push_back(std::move(b));
+        return;
+    }
+    int r_mid = r0 + (r1 - r0) / 2, c_mid = c0 + (c1 - c0) / 2;
+    hmatrix_build(h, op, r0, r_mid, c0, c_mid, tolerance, kernel_evals);
+    hmatrix_build(h, op, r0, r_mid, c_mid, c1, tolerance, kernel_evals);
+    hmatrix_build(h, op, r_mid, r1, c0, c_mid, tolerance, kernel_evals);
+    hmatrix_build(h, op, r_mid, r1, c_mid, c1, tolerance, kernel_evals);
+}
+
+inline size_t hmatrix_bytes(const HMatrix& h) {
+    return h.entries * sizeof(double);
+}
+
+inline void hmatrix_block_apply(const HMatrixBlock& b, const VectorXd& x, VectorXd& y) {
+    if (b.low_rank) {
+        y.segment(b.row0, b.rows).noalias() += b.u * (b.v.transpose() * x.segment(b.col0, b.cols));
+    } else {
+        y.segment(b.row0, b.rows).noalias() += b.u * x.segment(b.col0, b.cols);
+    }
+}
+
+// y += H x, each thread summing into its own copy in partial
+inline void hmatrix_apply(const HMatrix& h, const VectorXd& x, VectorXd& y, int n_threads,
+                   std::vector<VectorXd>& partial) {
+    int slots = std::min<int>(n_threads, h.blocks.size());
+    if (slots <= 1) {
+        for (const HMatrixBlock& b : h.blocks) hmatrix_block_apply(b, x, y);
+        return;
+    }
+    if ((int)partial.size() < slots) partial.resize(slots);
+    parallel_for(slots, slots, [&](int s) {
+        partial[s].setZero(y.size());
+        for (size_t k = s; k < h.blocks.size(); k += slots) hmatrix_block_apply(h.blocks[k], x, partial[s]);
+    });
+    for (int s = 0; s < slots; ++s) y += partial[s];
+}
+
+// A e from the block structure; a run of equal-strength panels is one
+// panel from its first node to its last
+inline VectorXd hmatrix_gauge_image(const PanelOperator& op, double& kernel_evals) {
+    const PanelFrames& f = op.f;
+    const Collocation& c = op.colloc;
+    VectorXd g = VectorXd::Zero(op.n + 1);
+    for (const HMatrixBlock& b : op.hmatrix.blocks) {
+        if (!b.low_rank) {
+            g.segment(b.row0, b.rows) += b.u.rowwise().sum();
+            continue;
+        }
+        int last = b.col0 + b.cols - 1;
+        double x1 = f.x1(b.col0), z1 = f.z1(b.col0), x2 = f.x2(last), z2 = f.z2(last);
+        double alpha = -std::atan2(z2 - z1, x2 - x1);
+        double cos_a = std::cos(alpha), sin_a = std::sin(alpha);
+        for (int i = b.row0; i < b.row0 + b.rows; ++i) {
+            double u, v;
+            doublet_unit_velocity(c.mid_x(i), c.mid_z(i), x1, z1, x2, z2, cos_a, sin_a, u, v);
+            g(i) += v * c.cos_beta(i) - u * c.sin_beta(i);
+        }
+        kernel_evals += b.rows;
+    }
+    return g;
+}
+
+// sparse LU of the dense leaves (A without the far field); false on failure
+inline bool hmatrix_near_field_lu(PanelOperator& op) {
+    int n = op.n;
+    std::vector<Triplet<double>> entries;
+    for (const HMatrixBlock& b : op.hmatrix.blocks) {
+        if (b.low_rank) continue;
+        for (int j = 0; j < b.cols; ++j) {
+            for (int i = 0; i < b.rows; ++i) entries.emplace_back(b.row0 + i, b.col0 + j, b.u(i, j) + 1.0 / n);
+        }
+    }
+    SparseMatrix<double> near(n, n);
+    near.setFromTriplets(entries.begin(), entries.end());
+    op.near_lu = std::make_unique<SparseLU<SparseMatrix<double>>>();
+    op.near_lu->compute(near);
+    if (op.near_lu->info() != Success) {
+        op.near_lu.reset();
+        return false;
+    }
+    return true;
+}
+
+// y = A x (or A_g x), kutta condition as the last row
+inline void panel_operator_apply(PanelOperator& op, const VectorXd& x, VectorXd& y) {
+    int n = op.n;
+    y.resize(n + 1);
+    const int rows = 64;
+    int chunks = (n + rows - 1) / rows;
+
+    if (op.use_tree) {
+        // the uniform body part goes through the exact A e
+        double gauge = x.head(n).mean();
+        VectorXd x_eval = remove_body_gauge(x, n);
+        panel_tree_moments(op.tree, op.f, x_eval);
+        std::atomic<long> direct{0};
+        parallel_for(chunks, op.n_threads, [&](int chunk) {
+            long chunk_direct = 0;
+            for (int i = chunk * rows; i < std::min(n, (chunk + 1) * rows); ++i) {
+                double u, v;
+                chunk_direct += panel_tree_velocity(op.tree, op.f, x_eval, op.colloc.mid_x(i), op.colloc.mid_z(i), u, v);
+                y(i) = v * op.colloc.cos_beta(i) - u * op.colloc.sin_beta(i);
+            }
+            direct += chunk_direct;
+        });
+        op.kernel_evals += double(direct.load());
+        y.head(n) += gauge * op.gauge_image.head(n);
+    } else if (op.use_hmatrix) {
+        double gauge = x.head(n).mean();
+        VectorXd x_eval = remove_body_gauge(x, n);
+        y.setZero();
+        hmatrix_apply(op.hmatrix, x_eval, y, op.n_threads, op.hmatrix_partial);
+        for (int i = 0; i < n; ++i) y(i) += x(n) * panel_influence(op, i, n) + gauge * op.gauge_image(i);
+        op.kernel_evals += n;
+    } else {
+        parallel_for(chunks, op.n_threads, [&](int chunk) {
+            for (int i = chunk * rows; i < std::min(n, (chunk + 1) * rows); ++i) {
+                double sum = 0.0;
+                for (int j = 0; j <= n; ++j) sum += x(j) * panel_influence(op, i, j);
+                y(i) = sum;
+            }
+        });
+        op.kernel_evals += double(n) * (n + 1);
+    }
+    kutta_row_apply(n, x, y);
+    if (op.gauge_fixed) y.head(n).array() += x.head(n).mean();
+}
+
+// z = M^-1 r with the schwarz blocks or the near-field LU
+inline void panel_operator_precondition(const PanelOperator& op, const VectorXd& r, VectorXd& z) {
+    int n = op.n;
+    z.resize(n + 1);
+    if (op.near_lu) {
+        z.head(n) = op.near_lu->solve(r.head(n));
+        z(n) = r(n);
+        return;
+    }
+    VectorXd rb, zb;
+    for (size_t k = 0; k < op.blocks.size(); ++k) {
+        const std::vector<int>& idx = op.block_panels[k];
+        int size = idx.size();
+        rb.resize(size);
+        for (int i = 0; i < size; ++i) rb(i) = r(idx[i]);
+        zb = op.blocks[k].solve(rb);
+        for (int i = op.overlap; i < size - op.overlap; ++i) z(idx[i]) = zb(i);
+    }
+    z(n) = r(n);
+}
+
+inline PanelOperator panel_operator(
+    const MatrixXd& panel_coord, int n, double tolerance, int n_threads, bool hmatrix = false) {
+
+    PanelOperator op;
+    op.n = n;
+    op.f = panel_frames(panel_coord, n + 1);
+    op.colloc = collocation_points(panel_coord, n);
+    op.n_threads = resolve_threads(n_threads);
+    if (hmatrix && tolerance > 0.0) {
+        op.use_hmatrix = true;
+        hmatrix_build(op.hmatrix, op, 0, n, 0, n, tolerance, op.kernel_evals);
+        op.gauge_image = hmatrix_gauge_image(op, op.kernel_evals);
+        if (hmatrix_near_field_lu(op)) return op;
+    }
+    op.use_tree = tolerance > 0.0 && !op.use_hmatrix;
+    if (op.use_tree) op.tree = build_panel_tree(op.f, tolerance);
+
+    // restricted additive schwarz over the gauge-fixed matrix, blocks
+    // overlapping by GMRES_OVERLAP and wrapping at the trailing edge
+    op.overlap = std::max(0, std::min(GMRES_OVERLAP, (n - GMRES_BLOCK) / 2));
+    for (int b = 0; b < n; b += GMRES_BLOCK) {
+        std::vector<int> idx;
+        int end = std::min(n, b + GMRES_BLOCK);
+        for (int i = b - op.overlap; i < end + op.overlap; ++i) idx.push_back((i + n) % n);
+        op.block_panels.push_back(idx);
+    }
+    for (const std::vector<int>& idx : op.block_panels) {
+        int size = idx.size();
+        MatrixXd block(size, size);
+        for (int j = 0; j < size; ++j) {
+            for (int i = 0; i < size; ++i) block(i, j) = panel_influence(op, idx[i], idx[j]) + 1.0 / n;
+        }
+        op.blocks.emplace_back(block);
+        op.kernel_evals += double(size) * size;
+    }
+
+    if (op.use_hmatrix) return op;
+
+    VectorXd e = VectorXd::Zero(n + 1);
+    e.head(n).setOnes();
+    bool use_tree = op.use_tree;
+    op.use_tree = false;
+    panel_operator_apply(op, e, op.gauge_image);
+    op.use_tree = use_tree;
+    op.gauge_image(n) = 0.0;
+
+    return op;
+}
+
+
+
+struct IterativeSolveInfo {
+    int iterations = 0;
+    double residual = 0.0;   // ||b - A x|| / ||b||
+    bool converged = false;
+};
+
+// restarted right-preconditioned GMRES from x = 0; stops at tolerance,
+// max_iterations, or when a cycle no longer halves the residual
+inline IterativeSolveInfo gmres_solve(
+    PanelOperator& op, const VectorXd& b, VectorXd& x, double tolerance, int max_iterations) {
+
+    int size = b.size();
+    int m = GMRES_RESTART;
+    IterativeSolveInfo info;
+    x.setZero(size);
+
+    double b_norm = b.norm();
+    if (b_norm == 0.0) {
+        info.converged = true;
+        return info;
+    }
+
+    MatrixXd V(size, m + 1);
+    MatrixXd H = MatrixXd::Zero(m + 1, m);
+    VectorXd cs(m), sn(m), g(m + 1);
+    VectorXd r = b, w, z;
+    double beta = b_norm;
+
+    while (info.iterations < max_iterations && beta > tolerance * b_norm) {
+        V.col(0) = r / beta;
+        g.setZero();
+        g(0) = beta;
+        H.setZero();
+
+        int k = 0;
+        while (k < m && info.iterations < max_iterations) {
+            panel_operator_precondition(op, V.col(k), z);
+            panel_operator_apply(op, z, w);
+            ++info.iterations;
+
+            for (int i = 0; i <= k; ++i) {
+                H(i, k) = w.dot(V.col(i));
+                w -= H(i, k) * V.col(i);
+            }
+            H(k + 1, k) = w.norm();
+            if (H(k + 1, k) > 0.0) V.col(k + 1) = w / H(k + 1, k);
+
+            for (int i = 0; i < k; ++i) {
+                double t = cs(i) * H(i, k) + sn(i) * H(i + 1, k);
+                H(i + 1, k) = -sn(i) * H(i, k) + cs(i) * H(i + 1, k);
+                H(i, k) = t;
+            }
+            double d = std::hypot(H(k, k), H(k + 1, k));
+            cs(k) = d > 0.0 ? H(k, k) / d : 1.0;
+            sn(k) = d > 0.0 ? H(k + 1, k) / d : 0.0;
+            H(k, k) = d;
+            H(k + 1, k) = 0.0;
+            g(k + 1) = -sn(k) * g(k);
+            g(k) *= cs(k);
+
+            ++k;
+            if (std::abs(g(k)) <= tolerance * b_norm) break;
+        }
+
+        VectorXd y = H.topLeftCorner(k, k).triangularView<Upper>().solve(g.head(k));
+        panel_operator_precondition(op, V.leftCols(k) * y, z);
+        x += z;
+
+        panel_operator_apply(op, x, w);
+        r = b - w;
+        double previous = beta;
+        beta = r.norm();
+        if (beta > 0.5 * previous) break;
+    }
+
+    info.residual = beta / b_norm;
+    info.converged = beta <= tolerance * b_norm;
+    return info;
+}
+
+// solve_system through GMRES; see panel_operator for the tolerances
+inline VectorXd solve_system_iterative(
+    const std::string& naca_code,
+    int n,
+    double u_fs,
+    double aoa,
+    double tolerance,
+    double far_field_tolerance,
+    bool hmatrix,
+    int n_threads,
+    MatrixXd& panel_coord,
+    IterativeSolveInfo& info,
+    double* kernel_evals = nullptr) {
+
+    panel_coord = panelgen(naca_code, n, aoa);
+    PanelOperator op = panel_operator(panel_coord, n, far_field_tolerance, n_threads, hmatrix);
+
+    op.gauge_fixed = true;
+    VectorXd B;
+    freestream_rhs(op.colloc, u_fs, aoa, B);
+
+    VectorXd mu;
+    info = gmres_solve(op, B, mu, tolerance, GMRES_MAX_ITERATIONS);
+
+    if (kernel_evals) *kernel_evals = op.kernel_evals;
+    return mu;
+}
+
+const int MIXED_REFINEMENT_STEPS = 10;
+
+// x = A^-1 b from a float factorization, refined in double
+inline IterativeSolveInfo refine_solve(
+    const MatrixXd& A,
+    const PartialPivLU<MatrixXf>& lu,
+    const VectorXd& b,
+    VectorXd& x,
+    double tolerance) {
+
+    IterativeSolveInfo info;
+    double b_norm = b.norm();
+    x = lu.solve(b.cast<float>()).cast<double>();
+    VectorXd r = b - A * x;
+    info.residual = b_norm > 0.0 ? r.norm() / b_norm : 0.0;
+    while (info.residual > tolerance && info.iterations < MIXED_REFINEMENT_STEPS) {
+        VectorXd x_next = x + lu.solve(r.cast<float>()).cast<double>();
+        VectorXd r_next = b - A * x_next;
+        double residual = r_next.norm() / b_norm;
+        ++info.iterations;
+        if (!(residual < info.residual)) break;
+        x.swap(x_next);
+        r.swap(r_next);
+        info.residual = residual;
+    }
+    info.converged = info.residual <= tolerance;
+    return info;
+}
+
+// solve_system with A_g factored in float and refined to double accuracy
+inline VectorXd solve_system_mixed(
+    const MatrixXd& panel_coord,
+    double u_fs,
+    int n,
+    double aoa,
+    double tolerance,
+    IterativeSolveInfo& info) {
+
+    MatrixXd A;
+    VectorXd B;
+    build_system(panel_coord, u_fs, n, aoa, A, B);
+    PartialPivLU<MatrixXf> lu(A.cast<float>());
+
+    VectorXd mu;
+    info = refine_solve(A, lu, B, mu, tolerance);
+    return mu;
+}
@@ -0,0 +1,423 @@
+#pragma once
+
+// gcc 12's avx512 headers trip -Wmaybe-uninitialized on their own undefined
+// vectors when Eigen's reductions inline them
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+#include <Eigen/Dense>
+#include <Eigen/SparseLU>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <complex>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+using namespace Eigen;
+
+inline bool point_in_polygon(double x, double y, const MatrixXd& polygon) {
+    bool inside = false;
+    int n = polygon.rows();
+    
+    for (int i = 0, j = n - 1; i < n; j = i++) {
+        double xi = polygon(i, 0), yi = polygon(i, 1);
+        double xj = polygon(j, 0), yj = polygon(j, 1);
+        
+        bool intersect = ((yi > y) != (yj > y)) && 
+                         (x < (xj - xi) * (y - yi) / (yj - yi) + xi);
+        
+        if (intersect) inside = !inside;
+    }
+    
+    return inside;
+}
+
+inline Matrix<bool, Dynamic, Dynamic> in_polygon(const MatrixXd& x, const MatrixXd& y, const MatrixXd& polygon) {
+    Matrix<bool, Dynamic, Dynamic> result(x.rows(), x.cols());
+
+    for (int i = 0; i < x.rows(); i++) {
+        for (int j = 0; j < x.cols(); j++) {
+            result(i, j) = point_in_polygon(x(i, j), y(i, j), polygon);
+        }
+    }
+    
+    return result;
+}
+
+// uniform grid; point (i, j) sits at (x(j), z(i))
+struct RegularGrid {
+    double x_min = 0, z_min = 0;
+    double dx = 0, dz = 0;
+    int nx = 0, nz = 0;
+
+    double x(int j) const { return x_min + j * dx; }
+    double z(int i) const { return z_min + i * dz; }
+    double x_max() const { return x(nx - 1); }
+    double z_max() const { return z(nz - 1); }
+};
+
+inline RegularGrid create_mesh(double x_min, double x_max, double z_min, double z_max, int nx, int nz) {
+    RegularGrid grid;
+    grid.x_min = x_min;
+    grid.z_min = z_min;
+    grid.dx = (x_max - x_min) / (nx - 1);
+    grid.dz = (z_max - z_min) / (nz - 1);
+    grid.nx = nx;
+    grid.nz = nz;
+    return grid;
+}
+
+inline bool same_grid(const RegularGrid& a, const RegularGrid& b) {
+    return a.nx == b.nx && a.nz == b.nz && a.x_min == b.x_min && a.z_min == b.z_min &&
+           a.dx == b.dx && a.dz == b.dz;
+}
+
+// point_in_polygon over a tensor-product grid, one row's crossings at a
+// time: O(rows * n + grid) instead of O(grid * n)
+inline void scanline_mask_into(
+    const VectorXd& x_vec,
+    const VectorXd& z_vec,
+    const MatrixXd& polygon,
+    Matrix<bool, Dynamic, Dynamic>& result,
+    std::vector<double>& crossings) {
+
+    int nz = z_vec.size();
+    int nx = x_vec.size();
+    int n = polygon.rows();
+    result.resize(nz, nx);
+    crossings.reserve(n);
+
+    for (int i = 0; i < nz; ++i) {
+        double y = z_vec(i);
+
+        crossings.clear();
+        for (int k = 0, l = n - 1; k < n; l = k++) {
+            double xk = polygon(k, 0), yk = polygon(k, 1);
+            double xl = polygon(l, 0), yl = polygon(l, 1);
+            if ((yk > y) != (yl > y)) {
+                crossings.push_back((xl - xk) * (y - yk) / (yl - yk) + xk);
+            }
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        // inside when an odd number of crossings lie to the right
+        int m = crossings.size();
+        int passed = 0;
+        for (int j = 0; j < nx; ++j) {
+            double x = x_vec(j);
+            while (passed < m && crossings[passed] <= x) ++passed;
+            result(i, j) = ((m - passed) & 1) != 0;
+        }
+    }
+}
+
+inline Matrix<bool, Dynamic, Dynamic> scanline_mask(
+    const VectorXd& x_vec,
+    const VectorXd& z_vec,
+    const MatrixXd& polygon) {
+
+    Matrix<bool, Dynamic, Dynamic> result;
+    std::vector<double> crossings;
+    scanline_mask_into(x_vec, z_vec, polygon, result, crossings);
+    return result;
+}
+
+// points within band cells of a mask transition
+inline Matrix<bool, Dynamic, Dynamic> near_wall_band(const Matrix<bool, Dynamic, Dynamic>& mask, int band) {
+    int rows = mask.rows();
+    int cols = mask.cols();
+    Matrix<bool, Dynamic, Dynamic> near = Matrix<bool, Dynamic, Dynamic>::Constant(rows, cols, false);
+
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j + 1 < cols; ++j) {
+            if (mask(i, j) == mask(i, j + 1)) continue;
+            int lo = std::max(0, j - band + 1);
+            int hi = std::min(cols - 1, j + band);
+            for (int k = lo; k <= hi; ++k) near(i, k) = true;
+        }
+    }
+
+    for (int j = 0; j < cols; ++j) {
+        for (int i = 0; i + 1 < rows; ++i) {
+            if (mask(i, j) == mask(i + 1, j)) continue;
+            int lo = std::max(0, i - band + 1);
+            int hi = std::min(rows - 1, i + band);
+            for (int k = lo; k <= hi; ++k) near(k, j) = true;
+        }
+    }
+
+    return near;
+}
+
+struct MaskScratch {
+    VectorXd x_vec, z_vec;
+    std::vector<double> crossings;
+};
+
+inline void mesh_interior_mask_into(
+    const RegularGrid& grid,
+    const MatrixXd& polygon,
+    Matrix<bool, Dynamic, Dynamic>& mask,
+    MaskScratch& scratch) {
+
+    scratch.x_vec.resize(grid.nx);
+    scratch.z_vec.resize(grid.nz);
+    for (int j = 0; j < grid.nx; ++j) scratch.x_vec(j) = grid.x(j);
+    for (int i = 0; i < grid.nz; ++i) scratch.z_vec(i) = grid.z(i);
+    scanline_mask_into(scratch.x_vec, scratch.z_vec, polygon, mask, scratch.crossings);
+}
+
+inline Matrix<bool, Dynamic, Dynamic> mesh_interior_mask(const RegularGrid& grid, const MatrixXd& polygon) {
+    Matrix<bool, Dynamic, Dynamic> mask;
+    MaskScratch scratch;
+    mesh_interior_mask_into(grid, polygon, mask, scratch);
+    return mask;
+}
+
+inline MatrixXd diff(const MatrixXd& mat) {
+    if (mat.rows() <= 1) return MatrixXd::Zero(0, mat.cols());
+    MatrixXd res(mat.rows() - 1, mat.cols());
+    res = mat.bottomRows(mat.rows() - 1) - mat.topRows(mat.rows() - 1);
+    return res;
+}
+
+inline ArrayXd masked_select(const ArrayXd& data, const Array<bool, Dynamic, 1>& mask) {
+    ArrayXd result(mask.count());
+    Index idx = 0;
+    for (Index i = 0; i < data.size(); ++i) {
+        if (mask(i)) result(idx++) = data(i);
+    }
+    return result;
+}
+
+inline ArrayXd masked_blend(
+    const Array<bool, Dynamic, 1>& mask,
+    const ArrayXd& true_values,
+    const ArrayXd& false_values
+) {
+    ArrayXd result(mask.size());
+    int idx_true = 0, idx_false = 0;
+    for (int i = 0; i < mask.size(); ++i) {
+        result(i) = mask(i) ? true_values(idx_true++) : false_values(idx_false++);
+    }
+    return result;
+}
+
+
+inline MatrixXd cdoublet(const MatrixXd& p, const MatrixXd& p1, const MatrixXd& p2) {
+    // get panel and point deltas
+    MatrixXd d_p2_p1 = p2 - p1;
+    MatrixXd d_p_p1 = p - p1;
+    MatrixXd d_p_p2 = p - p2;
+
+    // rotate into local frame 
+    ArrayXd alpha = -(d_p2_p1.col(1).array()).binaryExpr(d_p2_p1.col(0).array(),
+                                    [](double y, double x) { return std::atan2(y, x); });
+    // precompute for reuse
+    ArrayXd cos_alpha = alpha.cos();
+    ArrayXd sin_alpha = alpha.sin();
+
+    // get x projection in local frame
+    ArrayXd d1 = d_p_p1.col(0).array() * cos_alpha - d_p_p1.col(1).array() * sin_alpha;
+    ArrayXd d2 = d_p_p2.col(0).array() * cos_alpha - d_p_p2.col(1).array() * sin_alpha;
+    
+    // get vertical offset from panel in local frame
+    ArrayXd dz = d_p_p1.col(0).array() * sin_alpha + d_p_p1.col(1).array() * cos_alpha;
+
+    // check for singularity (on panel centerline)
+    auto branch = dz.abs() < 1e-6;
+
+    // precompute for reuse
+    ArrayXd d1_sq = d1.square();
+    ArrayXd d2_sq = d2.square();
+    ArrayXd dz_sq = dz.square();
+    ArrayXd denom_1 = d1_sq + dz_sq;
+    ArrayXd denom_2 = d2_sq + dz_sq;
+
+    // near-singular case: simplify doublet velocity field
+    ArrayXd u1_b1 = ArrayXd::Zero(dz.size());
+    ArrayXd v1_b1 = (d1 / d1_sq - d2 / d2_sq) / (2 * M_PI);
+
+    // general case for doublet velocity field
+    ArrayXd u1_b2 = -dz * (1.0 / denom_1 - 1.0 / denom_2) / (2 * M_PI);
+    ArrayXd v1_b2 = (d1 / denom_1 - d2 / denom_2) / (2 * M_PI);
+
+    // select based on dz
+    ArrayXd u1 = branch.select(u1_b1, u1_b2);
+    ArrayXd v1 = branch.select(v1_b1, v1_b2);
+
+    // rotate velocities back to global frame
+    ArrayXd u =  u1 * cos_alpha + v1 * sin_alpha;
+    ArrayXd v = -u1 * sin_alpha + v1 * cos_alpha;
+
+    // pack results into Nx2 matrix
+    MatrixXd uv(p.rows(), 2);
+    uv.col(0) = u.matrix();
+    uv.col(1) = v.matrix();
+    return uv;
+}
+
+
+
+// the wake runs one chord downstream of the trailing edge
+inline Vector2d wake_endpoint(double x_te, double z_te, double aoa) {
+    double wake_length = 1.0;
+    return Vector2d(x_te + wake_length * cos(-aoa), z_te + wake_length * sin(-aoa));
+}
+
+inline void set_wake(MatrixXd& panel_coord, int n, double aoa) {
+    panel_coord.row(n + 1) = wake_endpoint(panel_coord(0, 0), panel_coord(0, 1), aoa).transpose();
+}
+
+inline MatrixXd panelgen(const std::string& naca_code, int n, double aoa) {
+    if (naca_code.length() != 4) {
+        throw std::runtime_error("The NACA code must be a 4-digit number");
+    }
+
+    if (n <= 0) {
+        throw std::runtime_error("The number of panels must be a positive integer");
+    }
+
+
+    double m = (naca_code[0] - '0') * 1e-2; 
+    double p = (naca_code[1] - '0') * 1e-1; 
+    double t = std::stod(naca_code.substr(2, 2)) * 1e-2; 
+
+    VectorXd x_coord(n + 1);
+    for (int i = 0; i <= n; ++i) {
+        x_coord(i) = 1.0 - 0.5 * (1.0 - cos(2.0 * M_PI * i / n));
+    }
+
+    VectorXd y_camber(n + 1);
+    VectorXd y_thickness(n + 1);
+    VectorXd dyc_dx(n + 1);
+    
+    for (int i = 0; i <= n; ++i) {
+        double x = x_coord(i);
+        
+        if (x <= p) {
+            y_camber(i) = m / (p * p) * (2 * p * x - x * x);
+            dyc_dx(i) = 2 * m / (p * p) * (p - x);
+        } else {
+            y_camber(i) = m / ((1 - p) * (1 - p)) * ((1 - 2 * p) + 2 * p * x - x * x);
+            dyc_dx(i) = 2 * m / ((1 - p) * (1 - p)) * (p - x);
+        }
+        
+        y_thickness(i) = 5 * t * (0.2969 * sqrt(x) - 0.126 * x - 
+                                  0.3516 * x * x + 0.2843 * x * x * x - 
+                                  0.1015 * x * x * x * x);
+    }
+    
+    VectorXd theta = dyc_dx.array().atan();
+    
+    int le_idx;
+    x_coord.minCoeff(&le_idx);
+    
+    VectorXd x(n + 1), z(n + 1);
+    
+    for (int i = 0; i <= le_idx; ++i) {
+        x(i) = x_coord(i) + y_thickness(i) * sin(theta(i));
+        z(i) = y_camber(i) - y_thickness(i) * cos(theta(i));
+    }
+    
+    for (int i = le_idx; i <= n; ++i) {
+        x(i) = x_coord(i) - y_thickness(i) * sin(theta(i));
+        z(i) = y_camber(i) + y_thickness(i) * cos(theta(i));
+    }
+
+    
+    x(0) = x(n) = 0.5 * (x(0) + x(n));
+    z(0) = z(n) = 0.5 * (z(0) + z(n));
+    
+    MatrixXd result(n + 2, 2);
+    result.col(0).head(n + 1) = x;
+    result.col(1).head(n + 1) = z;
+    set_wake(result, n, aoa);
+    
+
+    return result;
+}
+
+
+// per-panel frames as separate arrays so the influence loops vectorize
+struct PanelFrames {
+    VectorXd x1, z1;
+    VectorXd x2, z2;
+    VectorXd cos_a, sin_a;
+};
+
+inline void panel_frames_into(const MatrixXd& panel_coord, int count, PanelFrames& f) {
+    f.x1 = panel_coord.col(0).head(count);
+    f.z1 = panel_coord.col(1).head(count);
+    f.x2 = panel_coord.col(0).segment(1, count);
+    f.z2 = panel_coord.col(1).segment(1, count);
+    f.cos_a.resize(count);
+    f.sin_a.resize(count);
+
+    // same rotation cdoublet uses, but evaluated once per panel
+    for (int k = 0; k < count; ++k) {
+        double alpha = -std::atan2(f.z2(k) - f.z1(k), f.x2(k) - f.x1(k));
+        f.cos_a(k) = std::cos(alpha);
+        f.sin_a(k) = std::sin(alpha);
+    }
+}
+
+inline PanelFrames panel_frames(const MatrixXd& panel_coord, int count) {
+    PanelFrames f;
+    panel_frames_into(panel_coord, count, f);
+    return f;
+}
+
+// scalar cdoublet for a unit-strength panel with a precomputed frame
+template <typename Real>
+inline void doublet_unit_velocity(
+    Real px, Real pz,
+    Real x1, Real z1, Real x2, Real z2,
+    Real cos_a, Real sin_a,
+    Real& u, Real& v) {
+
+    const Real two_pi = Real(2 * M_PI);
+
+    Real dx1 = px - x1, dz1 = pz - z1;
+    Real dx2 = px - x2, dz2 = pz - z2;
+
+    Real d1 = dx1 * cos_a - dz1 * sin_a;
+    Real d2 = dx2 * cos_a - dz2 * sin_a;
+    Real dz = dx1 * sin_a + dz1 * cos_a;
+
+    Real d1_sq = d1 * d1;
+    Real d2_sq = d2 * d2;
+    Real dz_sq = dz * dz;
+    Real denom_1 = d1_sq + dz_sq;
+    Real denom_2 = d2_sq + dz_sq;
+
+    // both branches are evaluated so the loop stays branch-free
+    bool on_line = std::abs(dz) < Real(1e-6);
+    Real u1 = on_line ? Real(0) : -dz * (Real(1) / denom_1 - Real(1) / denom_2) / two_pi;
+    Real v1 = on_line ? (d1 / d1_sq - d2 / d2_sq) / two_pi
+                      : (d1 / denom_1 - d2 / denom_2) / two_pi;
+
+    u =  u1 * cos_a + v1 * sin_a;
+    v = -u1 * sin_a + v1 * cos_a;
+}
+
+// stream function of a unit panel: vortices of -1 and +1 at its ends
+template <typename Real>
+inline Real doublet_unit_stream(Real px, Real pz, Real x1, Real z1, Real x2, Real z2) {
+    Real r1_sq = (px - x1) * (px - x1) + (pz - z1) * (pz - z1);
+    Real r2_sq = (px - x2) * (px - x2) + (pz - z2) * (pz - z2);
+    return std::log(r2_sq / r1_sq) / Real(4 * M_PI);
+}
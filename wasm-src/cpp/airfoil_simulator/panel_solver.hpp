@@ -0,0 +1,315 @@
+#pragma once
+
+#include "panel_geometry.hpp"
+
+struct Collocation {
+    VectorXd mid_x, mid_z;
+    VectorXd beta;
+    VectorXd sin_beta, cos_beta;
+};
+
+inline Collocation collocation_points(const MatrixXd& panel_coord, int n) {
+    Collocation c;
+    c.mid_x.resize(n);
+    c.mid_z.resize(n);
+    c.beta.resize(n);
+    c.sin_beta.resize(n);
+    c.cos_beta.resize(n);
+
+    for (int i = 0; i < n; ++i) {
+        double dx = panel_coord(i + 1, 0) - panel_coord(i, 0);
+        double dz = panel_coord(i + 1, 1) - panel_coord(i, 1);
+        c.beta(i) = std::atan2(dz, dx);
+        c.mid_x(i) = panel_coord(i, 0) + 0.5 * dx;
+        c.mid_z(i) = panel_coord(i, 1) + 0.5 * dz;
+        c.sin_beta(i) = std::sin(c.beta(i));
+        c.cos_beta(i) = std::cos(c.beta(i));
+    }
+    return c;
+}
+
+// normal velocity induced at every collocation point by one unit panel
+inline void influence_column(
+    double x1, double z1, double x2, double z2, double ca, double sa,
+    const Collocation& c, double* col) {
+
+    const double* mx = c.mid_x.data();
+    const double* mz = c.mid_z.data();
+    const double* sb = c.sin_beta.data();
+    const double* cb = c.cos_beta.data();
+    int n = c.mid_x.size();
+
+    for (int i = 0; i < n; ++i) {
+        double u, v;
+        doublet_unit_velocity(mx[i], mz[i], x1, z1, x2, z2, ca, sa, u, v);
+        col[i] = v * cb[i] - u * sb[i];
+    }
+}
+
+inline void influence_column(const PanelFrames& f, int j, const Collocation& c, double* col) {
+    influence_column(f.x1(j), f.z1(j), f.x2(j), f.z2(j), f.cos_a(j), f.sin_a(j), c, col);
+}
+
+// rows [0, n) of A; A must already be (n + 1) x (n + 1)
+inline void assemble_influence_into(
+    const MatrixXd& panel_coord, int n, const Collocation& c, MatrixXd& A, PanelFrames& f) {
+    panel_frames_into(panel_coord, n + 1, f);
+
+    // column-major A: panel j outer, collocation point i inner (contiguous)
+    for (int j = 0; j <= n; ++j) {
+        influence_column(f, j, c, A.col(j).data());
+    }
+}
+
+inline void assemble_influence(const MatrixXd& panel_coord, int n, const Collocation& c, MatrixXd& A) {
+    PanelFrames f;
+    assemble_influence_into(panel_coord, n, c, A, f);
+}
+
+// wake column only, for a new angle
+inline void wake_column(const MatrixXd& panel_coord, int n, double aoa, const Collocation& c, double* col) {
+    double x1 = panel_coord(n, 0), z1 = panel_coord(n, 1);
+    Vector2d end = wake_endpoint(panel_coord(0, 0), panel_coord(0, 1), aoa);
+    double alpha = -std::atan2(end(1) - z1, end(0) - x1);
+    influence_column(x1, z1, end(0), end(1), std::cos(alpha), std::sin(alpha), c, col);
+}
+
+inline void freestream_rhs(const Collocation& c, double u_fs, double aoa, VectorXd& B) {
+    int n = c.beta.size();
+    B.setZero(n + 1);
+    for (int i = 0; i < n; ++i) {
+        B(i) = -u_fs * std::sin(aoa - c.beta(i));
+    }
+}
+
+inline void kutta_row(int n, MatrixXd& A) {
+    A(n, 0) = 1;
+    A(n, n - 1) = -1;
+    A(n, n) = 1;
+}
+
+// the kutta row of A x, for products that never form A
+inline void kutta_row_apply(int n, const VectorXd& x, VectorXd& y) {
+    y(n) = x(0) - x(n - 1) + x(n);
+}
+
+// A is singular along the uniform body doublet; adding e v^T (v the body
+// mean) pins that constant
+inline void pin_body_gauge(int n, MatrixXd& A) {
+    A.topLeftCorner(n, n).array() += 1.0 / n;
+}
+
+// influence system, gauge pinned; the last row is the kutta condition
+inline void build_system(
+    const MatrixXd& panel_coord,
+    double u_fs,
+    int n,
+    double aoa,
+    MatrixXd& A,
+    VectorXd& B) {
+
+    Collocation c = collocation_points(panel_coord, n);
+    freestream_rhs(c, u_fs, aoa, B);
+
+    A.setZero(n + 1, n + 1);
+    assemble_influence(panel_coord, n, c, A);
+    kutta_row(n, A);
+    pin_body_gauge(n, A);
+}
+
+inline VectorXd solve_system(
+    const MatrixXd& panel_coord, 
+    double u_fs, 
+    int n, 
+    double aoa) {
+
+    MatrixXd A;
+    VectorXd B;
+    build_system(panel_coord, u_fs, n, aoa, A, B);
+
+    VectorXd mu = A.partialPivLu().solve(B);
+    return mu;
+}
+
+inline double elapsed_ms(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// factorization for one (naca, n). an AoA change only moves column n of A
+// (the wake), so it is a rank-1 sherman-morrison update of the reference
+struct BodySolveCache {
+    std::string naca;
+    int n = 0;
+    double aoa_ref = 0.0;
+    MatrixXd panel_coord;
+    Collocation colloc;
+    VectorXd wake_col_ref;
+    PartialPivLU<MatrixXd> lu;   // of A_g at aoa_ref
+
+    // running totals, read as differences by the stats
+    int factorizations = 0;
+    double kernel_evals = 0.0;
+    double assemble_ms = 0.0;
+    double factor_ms = 0.0;
+};
+
+// refactors around a new reference angle; A and f are scratch
+inline void refactor_reference(BodySolveCache& cache, double aoa, MatrixXd& A, PanelFrames& f) {
+    int n = cache.n;
+    auto t0 = std::chrono::steady_clock::now();
+    set_wake(cache.panel_coord, n, aoa);
+    A.setZero(n + 1, n + 1);
+    assemble_influence_into(cache.panel_coord, n, cache.colloc, A, f);
+    kutta_row(n, A);
+    pin_body_gauge(n, A);
+    cache.assemble_ms += elapsed_ms(t0);
+
+    auto t1 = std::chrono::steady_clock::now();
+    cache.wake_col_ref = A.col(n).head(n);
+    cache.lu.compute(A);
+    cache.aoa_ref = aoa;
+    cache.factor_ms += elapsed_ms(t1);
+
+    ++cache.factorizations;
+    cache.kernel_evals += double(n) * (n + 1);
+}
+
+inline void factor_reference(BodySolveCache& cache, const std::string& naca_code, int n, double aoa) {
+    auto t0 = std::chrono::steady_clock::now();
+    cache.panel_coord = panelgen(naca_code, n, aoa);
+    cache.colloc = collocation_points(cache.panel_coord, n);
+    cache.naca = naca_code;
+    cache.n = n;
+    cache.assemble_ms += elapsed_ms(t0);
+
+    MatrixXd A;
+    PanelFrames f;
+    refactor_reference(cache, aoa, A, f);
+}
+
+struct SolveScratch {
+    VectorXd B, w, z;
+    MatrixXd A;          // for refactoring around a new angle
+    PanelFrames frames;
+};
+
+// mu at (naca, n, aoa), refactoring only when the geometry changes;
+// allocation-free once the buffers are sized
+inline void solve_system_cached_into(
+    BodySolveCache& cache,
+    const std::string& naca_code,
+    int n,
+    double u_fs,
+    double aoa,
+    MatrixXd& panel_coord,
+    VectorXd& mu,
+    SolveScratch& s) {
+
+    if (cache.n != n || cache.naca != naca_code || cache.panel_coord.rows() != n + 2) {
+        factor_reference(cache, naca_code, n, aoa);
+    }
+
+    set_wake(cache.panel_coord, n, aoa);
+    panel_coord = cache.panel_coord;
+
+    freestream_rhs(cache.colloc, u_fs, aoa, s.B);
+    mu = cache.lu.solve(s.B);
+
+    if (aoa == cache.aoa_ref) return;
+
+    s.w.setZero(n + 1);
+    wake_column(panel_coord, n, aoa, cache.colloc, s.w.data());
+    cache.kernel_evals += n;
+    s.w.head(n) -= cache.wake_col_ref;
+
+    s.z = cache.lu.solve(s.w);
+    double denom = 1.0 + s.z(n);
+
+    // update is ill-conditioned; refactor around the new angle instead
+    if (std::abs(denom) < 1e-8) {
+        refactor_reference(cache, aoa, s.A, s.frames);
+        panel_coord = cache.panel_coord;
+        mu = cache.lu.solve(s.B);
+        return;
+    }
+
+    mu -= s.z * (mu(n) / denom);
+}
+
+inline VectorXd solve_system_cached(
+    BodySolveCache& cache,
+    const std::string& naca_code,
+    int n,
+    double u_fs,
+    double aoa,
+    MatrixXd& panel_coord) {
+
+    VectorXd mu;
+    SolveScratch scratch;
+    solve_system_cached_into(cache, naca_code, n, u_fs, aoa, panel_coord, mu, scratch);
+    return mu;
+}
+
+// cl over many angles (degrees) from one factorization: all right-hand
+// sides are solved together and only mu(n) of each update is formed
+inline VectorXd compute_polar_cached(
+    BodySolveCache& cache,
+    const std::string& naca_code,
+    int n,
+    const std::vector<double>& alphas_deg) {
+
+    int m = alphas_deg.size();
+    VectorXd cl(m);
+    if (m == 0) return cl;
+
+    double aoa_0 = alphas_deg[0] * M_PI / 180.0;
+    if (cache.n != n || cache.naca != naca_code || cache.panel_coord.rows() != n + 2) {
+        factor_reference(cache, naca_code, n, aoa_0);
+    }
+
+    // columns [0, m) freestream, [m, 2m) wake column deltas
+    MatrixXd rhs = MatrixXd::Zero(n + 1, 2 * m);
+    for (int k = 0; k < m; ++k) {
+        double aoa = alphas_deg[k] * M_PI / 180.0;
+        VectorXd B;
+        freestream_rhs(cache.colloc, 1.0, aoa, B);
+        rhs.col(k) = B;
+
+        wake_column(cache.panel_coord, n, aoa, cache.colloc, rhs.col(m + k).data());
+        rhs.col(m + k).head(n) -= cache.wake_col_ref;
+    }
+
+    MatrixXd sol = cache.lu.solve(rhs);
+
+    for (int k = 0; k < m; ++k) {
+        double y_n = sol(n, k);
+        double denom = 1.0 + sol(n, m + k);
+
+        if (std::abs(denom) < 1e-8) {
+            double aoa = alphas_deg[k] * M_PI / 180.0;
+            cl(k) = -2.0 * solve_system(panelgen(naca_code, n, aoa), 1.0, n, aoa)(n);
+        } else {
+            cl(k) = -2.0 * y_n / denom;
+        }
+    }
+    return cl;
+}
+
+// cl per angle in input order; empty with err set on failure
+struct PolarResult {
+    std::vector<double> cl;
+    std::string err;
+};
+
+// one factorization per call, freed on return
+inline PolarResult compute_polar(const std::string& naca_code, int n, const std::vector<double>& alphas_deg) {
+    BodySolveCache polar_cache;
+    PolarResult res;
+    try {
+        VectorXd cl = compute_polar_cached(polar_cache, naca_code, n, alphas_deg);
+        res.cl.assign(cl.data(), cl.data() + cl.size());
+    } catch (const std::exception& e) {
+        res.err = e.what();
+    }
+    return res;
+}
@@ -0,0 +1,333 @@
+#pragma once
+
+#include "analysis_options.hpp"
+#include "streamlines.hpp"
+
+// uniform hash of the points placed so far, chained through next
+struct SeparationHash {
+    double x_min = 0, z_min = 0, cell = 0;
+    int nx = 0, nz = 0;
+    std::vector<int> head;   // first point of each cell, -1 when empty
+    std::vector<int> next;
+    std::vector<double> x, z;
+};
+
+inline void separation_hash_reset(SeparationHash& hash, const RegularGrid& grid, double cell) {
+    hash.x_min = grid.x_min;
+    hash.z_min = grid.z_min;
+    hash.cell = cell;
+    hash.nx = std::max(1, (int)std::ceil((grid.x_max() - grid.x_min) / cell));
+    hash.nz = std::max(1, (int)std::ceil((grid.z_max() - grid.z_min) / cell));
+    hash.head.assign(size_t(hash.nx) * hash.nz, -1);
+    hash.next.clear();
+    hash.x.clear();
+    hash.z.clear();
+}
+
+inline int separation_hash_cell(const SeparationHash& hash, double x, double z, int& ci, int& cj) {
+    ci = std::min(std::max(0, (int)std::floor((z - hash.z_min) / hash.cell)), hash.nz - 1);
+    cj = std::min(std::max(0, (int)std::floor((x - hash.x_min) / hash.cell)), hash.nx - 1);
+    return ci + cj * hash.nz;
+}
+
+inline void separation_hash_insert(SeparationHash& hash, double x, double z) {
+    int ci, cj;
+    int c = separation_hash_cell(hash, x, z, ci, cj);
+    hash.next.push_back(hash.head[c]);
+    hash.head[c] = (int)hash.x.size();
+    hash.x.push_back(x);
+    hash.z.push_back(z);
+}
+
+inline bool separation_hash_near(const SeparationHash& hash, double x, double z, double radius) {
+    int ci, cj;
+    separation_hash_cell(hash, x, z, ci, cj);
+    int reach = (int)std::ceil(radius / hash.cell);
+    double r2 = radius * radius;
+    for (int j = std::max(0, cj - reach); j <= std::min(hash.nx - 1, cj + reach); ++j) {
+        for (int i = std::max(0, ci - reach); i <= std::min(hash.nz - 1, ci + reach); ++i) {
+            for (int p = hash.head[i + j * hash.nz]; p >= 0; p = hash.next[p]) {
+                double ex = hash.x[p] - x, ez = hash.z[p] - z;
+                if (ex * ex + ez * ez < r2) return true;
+            }
+        }
+    }
+    return false;
+}
+
+// stop within EVEN_TEST_RATIO * d_sep of a placed line, seed every
+// EVEN_SEED_SPACING * d_sep of arc, retry seeds in the body
+// EVEN_WALL_RATIO * d_sep out
+const double EVEN_TEST_RATIO = 0.6;
+const double EVEN_SEED_SPACING = 0.5;
+const double EVEN_WALL_RATIO = 0.7;
+const double EVEN_DEFAULT_SEPARATION = 1.3;
+
+// evenly spaced streamlines after Jobard and Lefer. lines are queued first
+// in, first out; when the queue drains the next of n_edge left-edge seeds
+// restarts it. lines come out upstream to downstream
+template <typename Real, typename Sampler, typename Begin, typename Emit, typename End>
+void trace_evenly_spaced_streamlines(
+    const Sampler& sample,
+    const RegularGrid& grid,
+    double d_sep,
+    int n_edge,
+    double dt, int max_steps,
+    const Begin& begin_line,
+    const Emit& emit,
+    const End& end_line,
+    AnalysisStats* stats = nullptr) {
+
+    const double d_test = EVEN_TEST_RATIO * d_sep;
+    const double insert_spacing = 0.25 * d_test;
+    SeparationHash hash;
+    separation_hash_reset(hash, grid, d_test);
+
+    // a stagnant point counts as masked
+    auto seed_status = [&](double x, double z) {
+        Real u, v;
+        SampleStatus st = sample(Real(x), Real(z), u, v);
+        if (st == SAMPLE_OK && std::sqrt(double(u) * u + double(v) * v) < 1e-6) st = SAMPLE_MASKED;
+        return st;
+    };
+    auto valid_seed = [&](double x, double z, double clearance) {
+        return !separation_hash_near(hash, x, z, clearance) && seed_status(x, z) == SAMPLE_OK;
+    };
+
+    std::vector<std::vector<Real>> lines;   // x z pairs
+    std::vector<Real> back;
+    auto trace_line = [&](double x0, double z0) {
+        CountingSampler<Sampler> counted{sample};
+        int steps = 0;
+        auto keep_to = [&](std::vector<Real>& out) {
+            return [&](Real x, Real z) {
+                if (separation_hash_near(hash, x, z, d_test)) return false;
+                ++steps;
+                out.push_back(x);
+                out.push_back(z);
+                return true;
+            };
+        };
+        back.clear();
+        trace_streamline_rk4_while<Real>(counted, x0, z0, -dt, max_steps, keep_to(back));
+        std::vector<Real> line;
+        line.reserve(back.size() + 2);
+        for (size_t p = back.size(); p >= 2; p -= 2) {
+            line.push_back(back[p - 2]);
+            line.push_back(back[p - 1]);
+        }
+        line.push_back(Real(x0));
+        line.push_back(Real(z0));
+        StreamlineEnd end = trace_streamline_rk4_while<Real>(counted, x0, z0, dt, max_steps, keep_to(line));
+
+        // hashed only now, so a line does not stop against itself
+        double last_x = 0, last_z = 0;
+        for (size_t p = 0; p < line.size(); p += 2) {
+            double ex = line[p] - last_x, ez = line[p + 1] - last_z;
+            if (p == 0 || p + 2 == line.size() || ex * ex + ez * ez >= insert_spacing * insert_spacing) {
+                separation_hash_insert(hash, line[p], line[p + 1]);
+                last_x = line[p];
+                last_z = line[p + 1];
+            }
+        }
+
+        begin_line();
+        for (size_t p = 0; p < line.size(); p += 2) emit(line[p], line[p + 1]);
+        end_line();
+        if (stats) {
+            stats->line_steps.push_back(steps);
+            stats->line_lookups.push_back(counted.lookups);
+            stats->line_end.push_back(end);
+        }
+        lines.push_back(std::move(line));
+    };
+
+    double x_edge = grid.x_min, z_min = grid.z_min, z_max = grid.z_max();
+    size_t queued = 0;
+    for (int e = 0; e < n_edge; ++e) {
+        double z_edge = z_min + (z_max - z_min) * (e + 0.5) / n_edge;
+        if (!valid_seed(x_edge, z_edge, d_sep)) continue;
+        trace_line(x_edge, z_edge);
+
+        for (; queued < lines.size(); ++queued) {
+            double since = EVEN_SEED_SPACING * d_sep;
+            for (size_t p = 0; p < lines[queued].size(); p += 2) {
+                const std::vector<Real>& line = lines[queued];
+                if (p > 0) {
+                    double ex = line[p] - line[p - 2], ez = line[p + 1] - line[p - 1];
+                    since += std::sqrt(ex * ex + ez * ez);
+                }
+                if (since < EVEN_SEED_SPACING * d_sep && p + 2 < line.size()) continue;
+
+                size_t a = p >= 2 ? p - 2 : p, b = p + 2 < line.size() ? p + 2 : p;
+                double tx = line[b] - line[a], tz = line[b + 1] - line[a + 1];
+                double len = std::sqrt(tx * tx + tz * tz);
+                if (len == 0.0) continue;
+                since = 0.0;
+                double x = line[p], z = line[p + 1];
+                for (double side : {1.0, -1.0}) {
+                    double nx = -side * tz / len, nz = side * tx / len;
+                    double sx = x + d_sep * nx, sz = z + d_sep * nz;
+                    // clamp seeds onto the grid edge, or out of the body
+                    double cx = std::min(std::max(sx, grid.x_min), grid.x_max());
+                    double cz = std::min(std::max(sz, grid.z_min), grid.z_max());
+                    double clearance = d_sep;
+                    if (cx != sx || cz != sz) {
+                        clearance = d_test;
+                    } else if (seed_status(sx, sz) == SAMPLE_MASKED) {
+                        cx = x + EVEN_WALL_RATIO * d_sep * nx;
+                        cz = z + EVEN_WALL_RATIO * d_sep * nz;
+                        clearance = d_test;
+                    }
+                    if (valid_seed(cx, cz, clearance)) trace_line(cx, cz);
+                }
+            }
+        }
+    }
+}
+
+template <typename Real, typename Sampler, typename Begin, typename Emit, typename End>
+void trace_seeded_streamlines_exact(
+    const Sampler& sample,
+    const RegularGrid& grid,
+    double u_fs,
+    int n_streamlines,
+    const AnalysisOptions& options,
+    const Begin& begin_line,
+    const Emit& emit,
+    const End& end_line,
+    AnalysisStats* stats = nullptr,
+    StreamlineBatch<Real>* batch = nullptr) {
+
+    double x_min = grid.x_min, z_min = grid.z_min, z_max = grid.z_max();
+
+    double dt = options.streamline_dt;
+    int max_steps = int(std::lround(0.2 / dt));
+
+    if (options.evenly_spaced_streamlines) {
+        double d_sep = options.streamline_separation > 0.0 ? options.streamline_separation
+                     : n_streamlines > 0 ? EVEN_DEFAULT_SEPARATION * (z_max - z_min) / n_streamlines : 0.0;
+        if (d_sep > 0.0) {
+            trace_evenly_spaced_streamlines<Real>(sample, grid, d_sep, std::max(n_streamlines, 1), dt, max_steps,
+                                                  begin_line, emit, end_line, stats);
+        }
+        return;
+    }
+
+    if (options.batched_streamlines && !options.adaptive_streamlines) {
+        StreamlineBatch<Real> local;
+        StreamlineBatch<Real>& b = batch ? *batch : local;
+        b.seed_x.assign(n_streamlines, x_min);
+        b.seed_z.resize(n_streamlines);
+        for (int i = 0; i < n_streamlines; ++i) b.seed_z[i] = z_min + (z_max - z_min) * (i + 0.5) / n_streamlines;
+        trace_streamlines_batched<Real>(sample, b, b.seed_x.data(), b.seed_z.data(), n_streamlines, dt, max_steps);
+
+        for (int i = 0; i < n_streamlines; ++i) {
+            const std::vector<Real>& pts = b.points[i];
+            begin_line();
+            for (size_t p = 0; p < pts.size(); p += 2) emit(pts[p], pts[p + 1]);
+            end_line();
+            if (stats) {
+                int steps = pts.size() / 2;
+                stats->line_steps.push_back(steps);
+                stats->line_lookups.push_back(4 * steps + (b.end[i] != END_MAX_STEPS));
+                stats->line_end.push_back(b.end[i]);
+            }
+        }
+        return;
+    }
+
+    AdaptiveStreamlineSettings adaptive;
+    adaptive.tolerance = options.streamline_tolerance;
+    adaptive.max_length = dt * max_steps * std::abs(u_fs);
+    adaptive.h_edge = grid.dx;
+    adaptive.h_max = 8.0 * adaptive.h_edge;
+    adaptive.max_steps = max_steps;
+    
+    for (int i = 0; i < n_streamlines; ++i) {
+        double z0 = z_min + (z_max - z_min) * (i + 0.5) / n_streamlines;
+        double x0 = x_min;
+        
+        begin_line();
+        if (stats) {
+            CountingSampler<Sampler> counted{sample};
+            int steps = 0;
+            auto counted_emit = [&](auto x, auto z) {
+                ++steps;
+                emit(x, z);
+            };
+            StreamlineEnd end = options.adaptive_streamlines
+                ? trace_streamline_adaptive(counted, x0, z0, adaptive, counted_emit)
+                : trace_streamline_rk4<Real>(counted, x0, z0, dt, max_steps, counted_emit);
+            stats->line_steps.push_back(steps);
+            stats->line_lookups.push_back(counted.lookups);
+            stats->line_end.push_back(end);
+        } else if (options.adaptive_streamlines) {
+            trace_streamline_adaptive(sample, x0, z0, adaptive, emit);
+        } else {
+            trace_streamline_rk4<Real>(sample, x0, z0, dt, max_steps, emit);
+        }
+        end_line();
+    }
+}
+
+// n_streamlines lines seeded along the left edge (or evenly spaced), each
+// as begin_line(), emit(x, z) per point, end_line()
+template <typename Real, typename Sampler, typename Begin, typename Emit, typename End>
+void trace_seeded_streamlines(
+    const Sampler& sample,
+    const RegularGrid& grid,
+    double u_fs,
+    int n_streamlines,
+    const AnalysisOptions& options,
+    const Begin& begin_line,
+    const Emit& emit,
+    const End& end_line,
+    AnalysisStats* stats = nullptr,
+    StreamlineBatch<Real>* batch = nullptr) {
+
+    if (options.simplify_tolerance > 0.0) {
+        StreamlineBatch<Real> local;
+        StreamlineBatch<Real>& b = batch ? *batch : local;
+        std::vector<double>& pts = b.simplify.points;
+        trace_seeded_streamlines_exact<Real>(
+            sample, grid, u_fs, n_streamlines, options,
+            [&]() { pts.clear(); },
+            [&](double x, double z) {
+                pts.push_back(x);
+                pts.push_back(z);
+            },
+            [&]() {
+                simplify_polyline(pts, options.simplify_tolerance, b.simplify);
+                begin_line();
+                for (size_t p = 0; p < pts.size(); p += 2) emit(Real(pts[p]), Real(pts[p + 1]));
+                end_line();
+            },
+            stats, &b);
+        return;
+    }
+
+    trace_seeded_streamlines_exact<Real>(
+        sample, grid, u_fs, n_streamlines, options, begin_line, emit, end_line, stats, batch);
+}
+
+// trace_seeded_streamlines as matrices, dropping lines under two points
+template <typename Real, typename Sampler>
+std::vector<MatrixXd> seeded_streamlines(
+    const Sampler& sample,
+    const RegularGrid& grid,
+    double u_fs,
+    int n_streamlines,
+    const AnalysisOptions& options,
+    AnalysisStats* stats = nullptr) {
+
+    std::vector<MatrixXd> streamlines;
+    std::vector<Vector2d> points;
+    trace_seeded_streamlines<Real>(
+        sample, grid, u_fs, n_streamlines, options,
+        [&]() { points.clear(); },
+        [&](Real x, Real z) { points.push_back(Vector2d(x, z)); },
+        [&]() { if (points.size() > 1) streamlines.push_back(points_to_matrix(points)); },
+        stats);
+    return streamlines;
+}
@@ -0,0 +1,750 @@
+#pragma once
+
+#include "velocity_field.hpp"
+
+// bilinear lookup into a create_mesh field; status says why a lookup failed
+enum SampleStatus {
+    SAMPLE_OK = 0,
+    SAMPLE_OUTSIDE = 1,
+    SAMPLE_MASKED = 2
+};
+
+template <typename Real>
+struct BasicGridSampler {
+    const BasicVelocityField<Real>* field = nullptr;
+    double x_min = 0, x_max = 0, z_min = 0, z_max = 0;
+    double dx = 0, dz = 0;
+    int nx = 0, nz = 0;
+
+    BasicGridSampler(const BasicVelocityField<Real>& f, const RegularGrid& grid)
+        : field(&f),
+          x_min(grid.x_min), x_max(grid.x_max()),
+          z_min(grid.z_min), z_max(grid.z_max()),
+          dx(grid.dx), dz(grid.dz),
+          nx(grid.nx), nz(grid.nz) {}
+
+    template <typename T>
+    SampleStatus operator()(T x, T z, T& u, T& v) const {
+        if (x < T(x_min) || x > T(x_max) || z < T(z_min) || z > T(z_max)) return SAMPLE_OUTSIDE;
+
+        int i = std::min(std::max(0, (int)((z - T(z_min)) / T(dz))), nz - 2);
+        int j = std::min(std::max(0, (int)((x - T(x_min)) / T(dx))), nx - 2);
+
+        T fx = (x - T(x_min + j * dx)) / T(dx);
+        T fz = (z - T(z_min + i * dz)) / T(dz);
+
+        const Matrix<Real, Dynamic, Dynamic>& fu = field->u;
+        const Matrix<Real, Dynamic, Dynamic>& fv = field->v;
+        if (std::isnan(fu(i, j)) || std::isnan(fu(i + 1, j)) ||
+            std::isnan(fu(i, j + 1)) || std::isnan(fu(i + 1, j + 1))) {
+            return SAMPLE_MASKED;
+        }
+
+        u = (1-fx)*(1-fz)*fu(i,j) + fx*(1-fz)*fu(i,j+1) + (1-fx)*fz*fu(i+1,j) + fx*fz*fu(i+1,j+1);
+        v = (1-fx)*(1-fz)*fv(i,j) + fx*(1-fz)*fv(i,j+1) + (1-fx)*fz*fv(i+1,j) + fx*fz*fv(i+1,j+1);
+        return SAMPLE_OK;
+    }
+};
+
+typedef BasicGridSampler<double> GridSampler;
+
+// why a traced line stopped
+enum StreamlineEnd {
+    END_MAX_STEPS = 0,    // ran its full step budget
+    END_MAX_LENGTH = 1,   // reached the adaptive arc-length limit
+    END_OUTSIDE = 2,      // left the grid
+    END_MASKED = 3,       // ran into the body
+    END_STAGNATION = 4,   // velocity fell below 1e-6
+    END_MIN_STEP = 5,     // adaptive step shrank below h_min
+    END_SEPARATION = 6    // came within d_test of another evenly spaced line
+};
+
+template <typename Sampler>
+struct CountingSampler {
+    const Sampler& sample;
+    mutable int lookups = 0;
+
+    template <typename T>
+    SampleStatus operator()(T x, T z, T& u, T& v) const {
+        ++lookups;
+        return sample(x, z, u, v);
+    }
+};
+
+template <typename Point>
+MatrixXd points_to_matrix(const std::vector<Point>& points) {
+    MatrixXd streamline(points.size(), 2);
+    for (size_t i = 0; i < points.size(); ++i) {
+        streamline(i, 0) = points[i](0);
+        streamline(i, 1) = points[i](1);
+    }
+    return streamline;
+}
+
+// fixed-step RK4, handing each point to keep(x, z); a negative dt traces
+// upstream. ends after a failed lookup, or when keep returns false
+template <typename Real, typename Sampler, typename Keep>
+StreamlineEnd trace_streamline_rk4_while(
+    const Sampler& sample,
+    double x0, double z0,
+    double dt, int max_steps,
+    const Keep& keep) {
+
+    typedef Matrix<Real, 2, 1> Vector2r;
+    Vector2r pos = Vector2r(Real(x0), Real(z0));
+    Real h = Real(dt);
+
+    SampleStatus failed = SAMPLE_OK;
+    auto interpolate_velocity = [&](Real x, Real z) -> Vector2r {
+        Real u, v;
+        SampleStatus st = sample(x, z, u, v);
+        if (st != SAMPLE_OK) {
+            failed = st;
+            return Vector2r(0, 0);
+        }
+        return Vector2r(u, v);
+    };
+
+    const Real half = Real(0.5);
+    for (int step = 0; step < max_steps; ++step) {
+        Vector2r vel = interpolate_velocity(pos(0), pos(1));
+
+        if (vel.norm() < Real(1e-6)) {
+            return failed == SAMPLE_OUTSIDE ? END_OUTSIDE : failed == SAMPLE_MASKED ? END_MASKED : END_STAGNATION;
+        }
+
+        Vector2r k1 = vel;
+        Vector2r k2 = interpolate_velocity(pos(0) + half*h*k1(0), pos(1) + half*h*k1(1));
+        Vector2r k3 = interpolate_velocity(pos(0) + half*h*k2(0), pos(1) + half*h*k2(1));
+        Vector2r k4 = interpolate_velocity(pos(0) + h*k3(0), pos(1) + h*k3(1));
+
+        pos += h/Real(6) * (k1 + Real(2)*k2 + Real(2)*k3 + k4);
+        if (!keep(pos(0), pos(1))) return END_SEPARATION;
+    }
+    return END_MAX_STEPS;
+}
+
+template <typename Real, typename Sampler, typename Emit>
+StreamlineEnd trace_streamline_rk4(
+    const Sampler& sample,
+    double x0, double z0,
+    double dt, int max_steps,
+    const Emit& emit) {
+
+    return trace_streamline_rk4_while<Real>(sample, x0, z0, dt, max_steps, [&](Real x, Real z) {
+        emit(x, z);
+        return true;
+    });
+}
+
+template <typename Real, typename Sampler>
+MatrixXd integrate_streamline_rk4(
+    const Sampler& sample,
+    double x0, double z0,
+    double dt, int max_steps) {
+
+    std::vector<Matrix<Real, 2, 1>> points;
+    trace_streamline_rk4<Real>(sample, x0, z0, dt, max_steps,
+                               [&](Real x, Real z) { points.push_back(Matrix<Real, 2, 1>(x, z)); });
+    return points_to_matrix(points);
+}
+
+template <typename Real>
+MatrixXd calculate_streamline_as(
+    const BasicVelocityField<Real>& field,
+    const RegularGrid& grid,
+    double x0, double z0,
+    double dt, int max_steps) {
+
+    return integrate_streamline_rk4<Real>(BasicGridSampler<Real>(field, grid), x0, z0, dt, max_steps);
+}
+
+inline MatrixXd calculate_streamline(
+    const VelocityField& field,
+    const RegularGrid& grid,
+    double x0, double z0,
+    double dt, int max_steps) {
+
+    return calculate_streamline_as(field, grid, x0, z0, dt, max_steps);
+}
+
+struct PolylineScratch {
+    std::vector<double> points;   // x z pairs of the line being simplified
+    std::vector<int> stack;
+    std::vector<uint8_t> keep;
+};
+
+// douglas-peucker on the x z pairs in pts, in place; the ends are kept
+inline void simplify_polyline(std::vector<double>& pts, double tolerance, PolylineScratch& scratch) {
+    int n = int(pts.size() / 2);
+    if (n < 3) return;
+    std::vector<uint8_t>& keep = scratch.keep;
+    std::vector<int>& stack = scratch.stack;
+    keep.assign(n, 0);
+    keep[0] = keep[n - 1] = 1;
+    stack.clear();
+    stack.push_back(0);
+    stack.push_back(n - 1);
+    double tol2 = tolerance * tolerance;
+    while (!stack.empty()) {
+        int b = stack.back(); stack.pop_back();
+        int a = stack.back(); stack.pop_back();
+        double ax = pts[2 * a], az = pts[2 * a + 1];
+        double ex = pts[2 * b] - ax, ez = pts[2 * b + 1] - az;
+        double len2 = ex * ex + ez * ez;
+        // segment distance, so a chord much shorter than its arc still splits
+        int worst = -1;
+        double worst2 = tol2;
+        for (int k = a + 1; k < b; ++k) {
+            double px = pts[2 * k] - ax, pz = pts[2 * k + 1] - az;
+            double t = len2 > 0.0 ? std::min(std::max((px * ex + pz * ez) / len2, 0.0), 1.0) : 0.0;
+            double dx = px - t * ex, dz = pz - t * ez;
+            double d2 = dx * dx + dz * dz;
+            if (d2 > worst2) {
+                worst2 = d2;
+                worst = k;
+            }
+        }
+        if (worst < 0) continue;
+        keep[worst] = 1;
+        stack.push_back(a);
+        stack.push_back(worst);
+        stack.push_back(worst);
+        stack.push_back(b);
+    }
+    int kept = 0;
+    for (int k = 0; k < n; ++k) {
+        if (!keep[k]) continue;
+        pts[2 * kept] = pts[2 * k];
+        pts[2 * kept + 1] = pts[2 * k + 1];
+        ++kept;
+    }
+    pts.resize(2 * kept);
+}
+
+// structure-of-arrays lanes of a batched trace, reused between calls
+template <typename Real>
+struct StreamlineBatch {
+    std::vector<double> seed_x, seed_z;
+    std::vector<Real> x, z;         // positions of the live lanes
+    std::vector<Real> sx, sz;       // stage positions
+    std::vector<Real> k1u, k1v, k2u, k2v, k3u, k3v, k4u, k4v;
+    std::vector<uint8_t> status, failed;
+    std::vector<int> line;          // seed each lane traces
+    std::vector<std::vector<Real>> points;
+    std::vector<StreamlineEnd> end;
+    PolylineScratch simplify;   // for lines of any tracer
+};
+
+template <typename Real>
+size_t streamline_batch_bytes(const StreamlineBatch<Real>& batch) {
+    size_t bytes = (batch.x.capacity() + batch.z.capacity() + batch.sx.capacity() + batch.sz.capacity() +
+                    8 * batch.k1u.capacity()) * sizeof(Real) +
+                   (batch.seed_x.capacity() + batch.seed_z.capacity()) * sizeof(double) +
+                   2 * batch.status.capacity() + batch.line.capacity() * sizeof(int) +
+                   batch.end.capacity() * sizeof(StreamlineEnd) +
+                   batch.simplify.points.capacity() * sizeof(double) +
+                   batch.simplify.stack.capacity() * sizeof(int) + batch.simplify.keep.capacity();
+    for (const std::vector<Real>& p : batch.points) bytes += p.capacity() * sizeof(Real);
+    return bytes;
+}
+
+// one lookup per lane; velocity zero where status is not SAMPLE_OK
+template <typename Real, typename Sampler>
+void sample_lanes(
+    const Sampler& sample, int count, const Real* x, const Real* z, Real* u, Real* v, uint8_t* status) {
+
+    for (int k = 0; k < count; ++k) {
+        Real uk, vk;
+        SampleStatus st = sample(x[k], z[k], uk, vk);
+        status[k] = st;
+        u[k] = st == SAMPLE_OK ? uk : Real(0);
+        v[k] = st == SAMPLE_OK ? vk : Real(0);
+    }
+}
+
+// gathers and blends the corners of n lanes' cells
+template <typename Real>
+void blend_cells(
+    int n, const Real* __restrict fu, const Real* __restrict fv, int ld,
+    const int* __restrict cell, const Real* __restrict wx, const Real* __restrict wz,
+    const int* __restrict outside, Real* __restrict u, Real* __restrict v, uint8_t* __restrict status) {
+
+    for (int k = 0; k < n; ++k) {
+        int c = cell[k];
+        Real fx = wx[k], fz = wz[k];
+        Real u00 = fu[c], u10 = fu[c + 1], u01 = fu[c + ld], u11 = fu[c + ld + 1];
+        Real v00 = fv[c], v10 = fv[c + 1], v01 = fv[c + ld], v11 = fv[c + ld + 1];
+        // nan != nan; std::isnan does not vectorize
+        int masked = (u00 != u00) | (u10 != u10) | (u01 != u01) | (u11 != u11);
+        Real uk = (1-fx)*(1-fz)*u00 + fx*(1-fz)*u01 + (1-fx)*fz*u10 + fx*fz*u11;
+        Real vk = (1-fx)*(1-fz)*v00 + fx*(1-fz)*v01 + (1-fx)*fz*v10 + fx*fz*v11;
+        int st = outside[k] ? int(SAMPLE_OUTSIDE) : masked ? int(SAMPLE_MASKED) : int(SAMPLE_OK);
+        bool ok = st == SAMPLE_OK;
+        status[k] = uint8_t(st);
+        u[k] = ok ? uk : Real(0);
+        v[k] = ok ? vk : Real(0);
+    }
+}
+
+// BasicGridSampler with the branches as selects, in blocks of SAMPLE_BLOCK
+// lanes. vector extensions for the clamps since gcc branches on the scalar
+// form; blend_cells auto-vectorizes
+const int SAMPLE_BLOCK = 64;
+
+template <typename Real> struct SampleLanes;
+template <> struct SampleLanes<double> {
+    typedef double RealW __attribute__((__vector_size__(16)));
+    typedef int IntW __attribute__((__vector_size__(8)));
+    typedef double DoubleW __attribute__((__vector_size__(16)));
+};
+template <> struct SampleLanes<float> {
+    typedef float RealW __attribute__((__vector_size__(16)));
+    typedef int IntW __attribute__((__vector_size__(16)));
+    typedef double DoubleW __attribute__((__vector_size__(32)));
+};
+
+template <typename Real>
+void sample_lanes(
+    const BasicGridSampler<Real>& sample, int count, const Real* __restrict x, const Real* __restrict z,
+    Real* __restrict u, Real* __restrict v, uint8_t* __restrict status) {
+
+    const int W = 16 / sizeof(Real);
+    typedef typename SampleLanes<Real>::RealW RealW;
+    typedef typename SampleLanes<Real>::IntW IntW;
+    typedef typename SampleLanes<Real>::DoubleW DoubleW;
+
+    const Real x_min = Real(sample.x_min), x_max = Real(sample.x_max);
+    const Real z_min = Real(sample.z_min), z_max = Real(sample.z_max);
+    const Real dx = Real(sample.dx), dz = Real(sample.dz);
+    const Real i_max = Real(sample.nz - 2), j_max = Real(sample.nx - 2);
+    const double x0 = sample.x_min, z0 = sample.z_min, hx = sample.dx, hz = sample.dz;
+    const int ld = int(sample.field->u.rows());
+    const RealW zero = RealW{}, top_i = zero + i_max, top_j = zero + j_max;
+
+    int cell[SAMPLE_BLOCK], outside[SAMPLE_BLOCK];
+    Real wx[SAMPLE_BLOCK], wz[SAMPLE_BLOCK];
+    for (int k0 = 0; k0 < count; k0 += SAMPLE_BLOCK) {
+        int n = std::min(SAMPLE_BLOCK, count - k0);
+        for (int k = 0; k < n; k += W) {
+            RealW xk, zk;
+            if (k + W <= n) {
+                std::memcpy(&xk, x + k0 + k, sizeof(xk));
+                std::memcpy(&zk, z + k0 + k, sizeof(zk));
+            } else {
+                for (int l = 0; l < W; ++l) {
+                    xk[l] = x[k0 + std::min(k + l, n - 1)];
+                    zk[l] = z[k0 + std::min(k + l, n - 1)];
+                }
+            }
+            IntW out = __builtin_convertvector((xk < x_min) | (xk > x_max) | (zk < z_min) | (zk > z_max), IntW);
+            RealW ti = (zk - z_min) / dz, tj = (xk - x_min) / dx;
+            ti = ti > zero ? ti : zero;
+            tj = tj > zero ? tj : zero;
+            ti = ti < top_i ? ti : top_i;
+            tj = tj < top_j ? tj : top_j;
+            IntW i = __builtin_convertvector(ti, IntW), j = __builtin_convertvector(tj, IntW);
+            DoubleW cx = x0 + __builtin_convertvector(j, DoubleW) * hx;
+            DoubleW cz = z0 + __builtin_convertvector(i, DoubleW) * hz;
+            RealW fx = (xk - __builtin_convertvector(cx, RealW)) / dx;
+            RealW fz = (zk - __builtin_convertvector(cz, RealW)) / dz;
+            IntW c = i + j * ld;
+            std::memcpy(outside + k, &out, sizeof(out));
+            std::memcpy(wx + k, &fx, sizeof(fx));
+            std::memcpy(wz + k, &fz, sizeof(fz));
+            std::memcpy(cell + k, &c, sizeof(c));
+        }
+        blend_cells(n, sample.field->u.data(), sample.field->v.data(), ld, cell, wx, wz, outside,
+                    u + k0, v + k0, status + k0);
+    }
+}
+
+// trace_streamline_rk4 for count seeds in lockstep, retired lanes packed
+// out so the passes stay dense
+template <typename Real, typename Sampler>
+void trace_streamlines_batched(
+    const Sampler& sample,
+    StreamlineBatch<Real>& batch,
+    const double* x0, const double* z0, int count,
+    double dt, int max_steps) {
+
+    StreamlineBatch<Real>& b = batch;
+    for (std::vector<Real>* lane : {&b.x, &b.z, &b.sx, &b.sz, &b.k1u, &b.k1v, &b.k2u, &b.k2v,
+                                    &b.k3u, &b.k3v, &b.k4u, &b.k4v}) {
+        lane->resize(count);
+    }
+    b.status.resize(count);
+    b.failed.assign(count, SAMPLE_OK);
+    b.line.resize(count);
+    b.end.assign(count, END_MAX_STEPS);
+    if ((int)b.points.size() < count) b.points.resize(count);
+    for (int k = 0; k < count; ++k) {
+        b.x[k] = Real(x0[k]);
+        b.z[k] = Real(z0[k]);
+        b.line[k] = k;
+        b.points[k].clear();
+    }
+
+    const Real h = Real(dt);
+    const Real half = Real(0.5);
+    auto stage = [&](int live, const std::vector<Real>& px, const std::vector<Real>& pz,
+                     std::vector<Real>& ku, std::vector<Real>& kv) {
+        sample_lanes(sample, live, px.data(), pz.data(), ku.data(), kv.data(), b.status.data());
+        for (int k = 0; k < live; ++k) b.failed[k] = b.status[k] != SAMPLE_OK ? b.status[k] : b.failed[k];
+    };
+
+    int live = count;
+    for (int step = 0; step < max_steps && live > 0; ++step) {
+        stage(live, b.x, b.z, b.k1u, b.k1v);
+
+        int kept = 0;
+        for (int k = 0; k < live; ++k) {
+            if (std::sqrt(b.k1u[k] * b.k1u[k] + b.k1v[k] * b.k1v[k]) < Real(1e-6)) {
+                uint8_t failed = b.failed[k];
+                b.end[b.line[k]] = failed == SAMPLE_OUTSIDE ? END_OUTSIDE
+                                 : failed == SAMPLE_MASKED ? END_MASKED : END_STAGNATION;
+                continue;
+            }
+            b.x[kept] = b.x[k];
+            b.z[kept] = b.z[k];
+            b.k1u[kept] = b.k1u[k];
+            b.k1v[kept] = b.k1v[k];
+            b.failed[kept] = b.failed[k];
+            b.line[kept] = b.line[k];
+            ++kept;
+        }
+        live = kept;
+
+        for (int k = 0; k < live; ++k) {
+            b.sx[k] = b.x[k] + half*h*b.k1u[k];
+            b.sz[k] = b.z[k] + half*h*b.k1v[k];
+        }
+        stage(live, b.sx, b.sz, b.k2u, b.k2v);
+        for (int k = 0; k < live; ++k) {
+            b.sx[k] = b.x[k] + half*h*b.k2u[k];
+            b.sz[k] = b.z[k] + half*h*b.k2v[k];
+        }
+        stage(live, b.sx, b.sz, b.k3u, b.k3v);
+        for (int k = 0; k < live; ++k) {
+            b.sx[k] = b.x[k] + h*b.k3u[k];
+            b.sz[k] = b.z[k] + h*b.k3v[k];
+        }
+        stage(live, b.sx, b.sz, b.k4u, b.k4v);
+
+        for (int k = 0; k < live; ++k) {
+            b.x[k] += h/Real(6) * (b.k1u[k] + Real(2)*b.k2u[k] + Real(2)*b.k3u[k] + b.k4u[k]);
+            b.z[k] += h/Real(6) * (b.k1v[k] + Real(2)*b.k2v[k] + Real(2)*b.k3v[k] + b.k4v[k]);
+        }
+        for (int k = 0; k < live; ++k) {
+            std::vector<Real>& pts = b.points[b.line[k]];
+            pts.push_back(b.x[k]);
+            pts.push_back(b.z[k]);
+        }
+    }
+}
+
+// GridSampler over a LazyVelocityField; one per thread at most
+struct LazyGridSampler {
+    LazyVelocityField* lazy;
+    GridSampler base;
+
+    explicit LazyGridSampler(LazyVelocityField& l) : lazy(&l), base(l.field, l.grid) {}
+
+    template <typename T>
+    SampleStatus operator()(T x, T z, T& u, T& v) const {
+        if (x < T(base.x_min) || x > T(base.x_max) || z < T(base.z_min) || z > T(base.z_max)) {
+            return SAMPLE_OUTSIDE;
+        }
+        int i = std::min(std::max(0, (int)((z - T(base.z_min)) / T(base.dz))), base.nz - 2);
+        int j = std::min(std::max(0, (int)((x - T(base.x_min)) / T(base.dx))), base.nx - 2);
+        lazy_field_fill_cell(*lazy, i, j);
+        return base(x, z, u, v);
+    }
+};
+
+struct AdaptiveStreamlineSettings {
+    double tolerance = 1e-5;    // local error per step, in chord lengths
+    double max_length = 3.0;    // arc length at which the line stops
+    double h_min = 1e-6;
+    double h_max = 0.1;
+    double h_edge = 0.01;       // steps leaving the grid are halved down to this
+    int max_steps = 2000;
+};
+
+// dormand-prince 5(4) on the unit tangent, so steps are in arc length.
+// ends on leaving the grid, at stagnation or at max_length
+template <typename Sampler, typename Emit>
+StreamlineEnd trace_streamline_adaptive(
+    const Sampler& sample,
+    double x0, double z0,
+    const AdaptiveStreamlineSettings& cfg,
+    const Emit& emit,
+    int* evals = nullptr) {
+
+    static const double c[7][6] = {
+        {0, 0, 0, 0, 0, 0},
+        {1.0/5, 0, 0, 0, 0, 0},
+        {3.0/40, 9.0/40, 0, 0, 0, 0},
+        {44.0/45, -56.0/15, 32.0/9, 0, 0, 0},
+        {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729, 0, 0},
+        {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656, 0},
+        {35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}
+    };
+    static const double e[7] = {
+        35.0/384 - 5179.0/57600, 0, 500.0/1113 - 7571.0/16695, 125.0/192 - 393.0/640,
+        -2187.0/6784 + 92097.0/339200, 11.0/84 - 187.0/2100, -1.0/40
+    };
+
+    int n_evals = 0;
+    bool stagnant = false;
+    auto tangent = [&](double x, double z, double& tx, double& tz) -> SampleStatus {
+        ++n_evals;
+        stagnant = false;
+        double u, v;
+        SampleStatus st = sample(x, z, u, v);
+        if (st != SAMPLE_OK) return st;
+        double speed = std::sqrt(u * u + v * v);
+        stagnant = speed < 1e-6;
+        if (stagnant) return SAMPLE_MASKED;
+        tx = u / speed;
+        tz = v / speed;
+        return SAMPLE_OK;
+    };
+
+    double x = x0, z = z0;
+    double kx[7], kz[7];
+    auto failure = [&](SampleStatus st) {
+        return st == SAMPLE_OUTSIDE ? END_OUTSIDE : stagnant ? END_STAGNATION : END_MASKED;
+    };
+
+    StreamlineEnd end = END_MAX_STEPS;
+    SampleStatus first = tangent(x, z, kx[0], kz[0]);
+    if (first != SAMPLE_OK) {
+        end = failure(first);
+    } else {
+        double h = std::min(cfg.h_max, 0.01);
+        double s = 0.0;
+        int steps = 0;
+
+        while (true) {
+            if (s >= cfg.max_length) {
+                end = END_MAX_LENGTH;
+                break;
+            }
+            if (steps >= cfg.max_steps) {
+                end = END_MAX_STEPS;
+                break;
+            }
+            h = std::min(h, cfg.max_length - s);
+
+            SampleStatus st = SAMPLE_OK;
+            for (int stage = 1; stage < 7 && st == SAMPLE_OK; ++stage) {
+                double sx = x, sz = z;
+                for (int q = 0; q < stage; ++q) {
+                    sx += h * c[stage][q] * kx[q];
+                    sz += h * c[stage][q] * kz[q];
+                }
+                st = tangent(sx, sz, kx[stage], kz[stage]);
+            }
+
+            if (st == SAMPLE_OUTSIDE) {
+                if (h <= cfg.h_edge) {
+                    end = END_OUTSIDE;
+                    break;
+                }
+                h = std::max(0.5 * h, cfg.h_edge);
+                continue;
+            }
+            if (st != SAMPLE_OK) {
+                h *= 0.5;
+                if (h < cfg.h_min) {
+                    end = failure(st);
+                    break;
+                }
+                continue;
+            }
+
+            double ex = 0.0, ez = 0.0;
+            for (int q = 0; q < 7; ++q) {
+                ex += e[q] * kx[q];
+                ez += e[q] * kz[q];
+            }
+            double err = h * std::sqrt(ex * ex + ez * ez);
+
+            if (err <= cfg.tolerance) {
+                for (int q = 0; q < 6; ++q) {
+                    x += h * c[6][q] * kx[q];
+                    z += h * c[6][q] * kz[q];
+                }
+                s += h;
+                ++steps;
+                emit(x, z);
+
+                // first same as last
+                kx[0] = kx[6];
+                kz[0] = kz[6];
+            }
+
+            double grow = err > 0.0 ? 0.9 * std::pow(cfg.tolerance / err, 0.2) : 5.0;
+            h = std::min(cfg.h_max, h * std::min(5.0, std::max(0.2, grow)));
+            if (h < cfg.h_min) {
+                end = END_MIN_STEP;
+                break;
+            }
+        }
+    }
+
+    if (evals) *evals = n_evals;
+    return end;
+}
+
+template <typename Sampler>
+MatrixXd integrate_streamline_adaptive(
+    const Sampler& sample,
+    double x0, double z0,
+    const AdaptiveStreamlineSettings& cfg,
+    int* evals = nullptr) {
+
+    std::vector<Vector2d> points;
+    trace_streamline_adaptive(sample, x0, z0, cfg,
+                              [&](double x, double z) { points.push_back(Vector2d(x, z)); }, evals);
+    return points_to_matrix(points);
+}
+
+// float field, double integration: the step control works near float epsilon
+template <typename Real>
+MatrixXd calculate_streamline_adaptive(
+    const BasicVelocityField<Real>& field,
+    const RegularGrid& grid,
+    double x0, double z0,
+    const AdaptiveStreamlineSettings& cfg) {
+
+    return integrate_streamline_adaptive(BasicGridSampler<Real>(field, grid), x0, z0, cfg);
+}
+
+// streamlines as isolines of psi by marching squares; levels evenly spaced
+// in psi across the inflow edge, segments chained through shared edges
+inline std::vector<MatrixXd> stream_function_contours(const MatrixXd& psi, const RegularGrid& grid, int n_levels) {
+    std::vector<MatrixXd> lines;
+    int nz = psi.rows();
+    int nx = psi.cols();
+    if (n_levels <= 0 || nz < 2 || nx < 2) return lines;
+
+    double lo = std::numeric_limits<double>::infinity();
+    double hi = -lo;
+    for (int i = 0; i < nz; ++i) {
+        if (std::isnan(psi(i, 0))) continue;
+        lo = std::min(lo, psi(i, 0));
+        hi = std::max(hi, psi(i, 0));
+    }
+    if (!(hi > lo)) return lines;
+
+    double step = (hi - lo) / n_levels;
+    double first = lo + 0.5 * step;
+
+    struct Segment {
+        long e0, e1;
+        Vector2d p0, p1;
+    };
+    std::vector<std::vector<Segment>> segments(n_levels);
+
+    // horizontal edge (i, j) is 2 (i nx + j), vertical is that + 1
+    auto h_edge = [&](int i, int j) { return 2L * (long(i) * nx + j); };
+    auto v_edge = [&](int i, int j) { return 2L * (long(i) * nx + j) + 1; };
+
+    for (int i = 0; i + 1 < nz; ++i) {
+        double z0 = grid.z(i), z1 = grid.z(i + 1);
+
+        for (int j = 0; j + 1 < nx; ++j) {
+            double a = psi(i, j), b = psi(i, j + 1);
+            double c = psi(i + 1, j + 1), d = psi(i + 1, j);
+            if (std::isnan(a) || std::isnan(b) || std::isnan(c) || std::isnan(d)) continue;
+
+            double x0 = grid.x(j), x1 = grid.x(j + 1);
+            double mn = std::min(std::min(a, b), std::min(c, d));
+            double mx = std::max(std::max(a, b), std::max(c, d));
+
+            int k_lo = std::max(0, (int)std::ceil((mn - first) / step));
+            int k_hi = std::min(n_levels - 1, (int)std::floor((mx - first) / step));
+
+            for (int k = k_lo; k <= k_hi; ++k) {
+                double level = first + k * step;
+                bool sa = a >= level, sb = b >= level, sc = c >= level, sd = d >= level;
+
+                // bottom, right, top, left
+                long ids[4] = {h_edge(i, j), v_edge(i, j + 1), h_edge(i + 1, j), v_edge(i, j)};
+                bool cut[4] = {sa != sb, sb != sc, sd != sc, sa != sd};
+                Vector2d pts[4];
+                if (cut[0]) pts[0] = Vector2d(x0 + (level - a) / (b - a) * (x1 - x0), z0);
+                if (cut[1]) pts[1] = Vector2d(x1, z0 + (level - b) / (c - b) * (z1 - z0));
+                if (cut[2]) pts[2] = Vector2d(x0 + (level - d) / (c - d) * (x1 - x0), z1);
+                if (cut[3]) pts[3] = Vector2d(x0, z0 + (level - a) / (d - a) * (z1 - z0));
+
+                int n_cut = cut[0] + cut[1] + cut[2] + cut[3];
+                if (n_cut == 2) {
+                    int e[2], m = 0;
+                    for (int q = 0; q < 4; ++q) if (cut[q]) e[m++] = q;
+                    segments[k].push_back({ids[e[0]], ids[e[1]], pts[e[0]], pts[e[1]]});
+                } else if (n_cut == 4) {
+                    bool centre = 0.25 * (a + b + c + d) >= level;
+                    if (centre == sa) {
+                        segments[k].push_back({ids[0], ids[1], pts[0], pts[1]});
+                        segments[k].push_back({ids[2], ids[3], pts[2], pts[3]});
+                    } else {
+                        segments[k].push_back({ids[0], ids[3], pts[0], pts[3]});
+                        segments[k].push_back({ids[1], ids[2], pts[1], pts[2]});
+                    }
+                }
+            }
+        }
+    }
+
+    for (const std::vector<Segment>& segs : segments) {
+        if (segs.empty()) continue;
+
+        std::unordered_map<long, std::pair<int, int>> by_edge;
+        by_edge.reserve(segs.size() * 2);
+        for (int sidx = 0; sidx < (int)segs.size(); ++sidx) {
+            for (long e : {segs[sidx].e0, segs[sidx].e1}) {
+                auto it = by_edge.emplace(e, std::make_pair(sidx, -1)).first;
+                if (it->second.first != sidx) it->second.second = sidx;
+            }
+        }
+
+        std::vector<bool> used(segs.size(), false);
+        auto walk = [&](int sidx, long entry) {
+            std::vector<Vector2d> pts;
+            long edge = entry;
+            pts.push_back(segs[sidx].e0 == entry ? segs[sidx].p0 : segs[sidx].p1);
+
+            while (sidx >= 0 && !used[sidx]) {
+                used[sidx] = true;
+                const Segment& sg = segs[sidx];
+                bool forward = sg.e0 == edge;
+                edge = forward ? sg.e1 : sg.e0;
+                pts.push_back(forward ? sg.p1 : sg.p0);
+
+                const std::pair<int, int>& nb = by_edge[edge];
+                sidx = nb.first == sidx ? nb.second : nb.first;
+            }
+
+            if (pts.size() > 1) {
+                MatrixXd line(pts.size(), 2);
+                for (size_t q = 0; q < pts.size(); ++q) line.row(q) = pts[q].transpose();
+                lines.push_back(line);
+            }
+        };
+
+        for (int sidx = 0; sidx < (int)segs.size(); ++sidx) {
+            if (used[sidx]) continue;
+            for (long e : {segs[sidx].e0, segs[sidx].e1}) {
+                if (!used[sidx] && by_edge[e].second < 0) walk(sidx, e);
+            }
+        }
+        for (int sidx = 0; sidx < (int)segs.size(); ++sidx) {
+            if (!used[sidx]) walk(sidx, segs[sidx].e0);
+        }
+    }
+
+    return lines;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// the browser build only gets threads when compiled with -pthread
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define AIRFOIL_THREADS 1
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#else
+#define AIRFOIL_THREADS 0
+#endif
+
+// 0 means one thread per hardware core
+inline int resolve_threads(int requested) {
+#if AIRFOIL_THREADS
+    if (requested > 0) return requested;
+    return std::max(1u, std::thread::hardware_concurrency());
+#else
+    (void)requested;
+    return 1;
+#endif
+}
+
+#if AIRFOIL_THREADS
+// persistent workers, started on first use. one job at a time: a
+// parallel_for issued while the pool is busy runs serially on its caller
+// (counted in serial_runs)
+struct ThreadPool {
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::vector<std::thread> workers;
+    void (*run)(void*) = nullptr;
+    void* context = nullptr;
+    long generation = 0;   // bumped per job
+    int wanted = 0;        // workers 0 .. wanted - 1 join the current job
+    int active = 0;        // of those, still running it
+    bool stop = false;
+    std::atomic<bool> busy{false};
+    std::atomic<long> serial_runs{0};   // parallel_for calls that found the pool busy
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers) t.join();
+    }
+};
+
+inline ThreadPool& thread_pool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+inline void thread_pool_worker(ThreadPool& pool, int index) {
+    long seen = 0;
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    for (;;) {
+        pool.wake.wait(lock, [&] { return pool.stop || (pool.generation != seen && index < pool.wanted); });
+        if (pool.stop) return;
+        seen = pool.generation;
+        lock.unlock();
+        pool.run(pool.context);
+        lock.lock();
+        if (--pool.active == 0) pool.done.notify_one();
+    }
+}
+
+// false, without running anything, when the pool is busy
+inline bool thread_pool_run(int helpers, void (*run)(void*), void* context) {
+    ThreadPool& pool = thread_pool();
+    if (pool.busy.exchange(true)) return false;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        while ((int)pool.workers.size() < helpers) {
+            int index = pool.workers.size();
+            pool.workers.emplace_back([&pool, index] { thread_pool_worker(pool, index); });
+        }
+        pool.run = run;
+        pool.context = context;
+        pool.wanted = helpers;
+        pool.active = helpers;
+        ++pool.generation;
+    }
+    pool.wake.notify_all();
+    run(context);
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool.done.wait(lock, [&] { return pool.active == 0; });
+        pool.wanted = 0;
+    }
+    pool.busy = false;
+    return true;
+}
+
+inline long thread_pool_serial_runs() {
+    return thread_pool().serial_runs;
+}
+
+template <typename Worker>
+void run_worker(void* worker) {
+    (*static_cast<Worker*>(worker))();
+}
+#endif
+
+// fn(task) for task in [0, count) on up to n_threads threads; serial on
+// the caller when the pool is busy
+template <typename Fn>
+void parallel_for(int count, int n_threads, const Fn& fn) {
+    std::atomic<int> next{0};
+    auto worker = [&]() {
+        for (int task = next++; task < count; task = next++) fn(task);
+    };
+
+#if AIRFOIL_THREADS
+    int helpers = std::min(n_threads, count) - 1;
+    if (helpers > 0) {
+        if (thread_pool_run(helpers, &run_worker<decltype(worker)>, &worker)) return;
+        ++thread_pool().serial_runs;
+    }
+#else
+    (void)n_threads;
+#endif
+    worker();
+}
@@ -0,0 +1,604 @@
+#pragma once
+
+#include "panel_geometry.hpp"
+#include "thread_pool.hpp"
+
+// field storage in double or float
+template <typename Real>
+struct BasicVelocityField {
+    Matrix<Real, Dynamic, Dynamic> u;
+    Matrix<Real, Dynamic, Dynamic> v;
+    Matrix<Real, Dynamic, Dynamic> psi;   // stream function, only filled when requested
+};
+
+typedef BasicVelocityField<double> VelocityField;
+typedef BasicVelocityField<float> VelocityFieldF;
+
+// the body mean of mu induces almost no velocity; sums that are not exact
+// cancellations work on mu with it removed
+inline VectorXd remove_body_gauge(const VectorXd& mu, int n) {
+    VectorXd shifted = mu;
+    shifted.head(n).array() -= mu.head(n).mean();
+    return shifted;
+}
+
+// tiles are small enough that a tile's points and accumulators stay in L1
+const int FIELD_TILE_ROWS = 64;
+const int FIELD_TILE_COLS = 16;
+
+// walks the outside points tile by tile on up to n_threads threads.
+// eval(px, pz, m, u, v, psi) adds the induced velocity (and psi when set)
+// of m points; inside points are NaN
+template <typename Real, typename Eval>
+void evaluate_field_tiles_into(
+    BasicVelocityField<Real>& field,
+    const RegularGrid& grid,
+    const Matrix<bool, Dynamic, Dynamic>& inside,
+    double u_inf,
+    double v_inf,
+    int n_threads,
+    bool with_psi,
+    const Eval& eval) {
+
+    int rows = grid.nz;
+    int cols = grid.nx;
+    Real nan = std::numeric_limits<Real>::quiet_NaN();
+
+    field.u.resize(rows, cols);
+    field.v.resize(rows, cols);
+    if (with_psi) field.psi.resize(rows, cols);
+
+    int tiles_r = (rows + FIELD_TILE_ROWS - 1) / FIELD_TILE_ROWS;
+    int tiles_c = (cols + FIELD_TILE_COLS - 1) / FIELD_TILE_COLS;
+
+    parallel_for(tiles_r * tiles_c, resolve_threads(n_threads), [&](int tile) {
+        int r0 = (tile % tiles_r) * FIELD_TILE_ROWS;
+        int c0 = (tile / tiles_r) * FIELD_TILE_COLS;
+        int r1 = std::min(r0 + FIELD_TILE_ROWS, rows);
+        int c1 = std::min(c0 + FIELD_TILE_COLS, cols);
+
+        const int cap = FIELD_TILE_ROWS * FIELD_TILE_COLS;
+        // zeroed only because gcc cannot see that eval reads the first m
+        Real px[cap] = {}, pz[cap] = {};
+        Real u_acc[cap], v_acc[cap], psi_acc[cap];
+        Index idx[cap];
+        int m = 0;
+
+        for (int j = c0; j < c1; ++j) {
+            double x = grid.x(j);
+            for (int i = r0; i < r1; ++i) {
+                if (inside(i, j)) {
+                    field.u(i, j) = nan;
+                    field.v(i, j) = nan;
+                    if (with_psi) field.psi(i, j) = nan;
+                    continue;
+                }
+                double z = grid.z(i);
+                px[m] = Real(x);
+                pz[m] = Real(z);
+                u_acc[m] = Real(u_inf);
+                v_acc[m] = Real(v_inf);
+                psi_acc[m] = Real(u_inf * z - v_inf * x);
+                idx[m] = i + Index(j) * rows;
+                ++m;
+            }
+        }
+
+        eval(px, pz, m, u_acc, v_acc, with_psi ? psi_acc : nullptr);
+
+        for (int p = 0; p < m; ++p) {
+            field.u(idx[p]) = u_acc[p];
+            field.v(idx[p]) = v_acc[p];
+            if (with_psi) field.psi(idx[p]) = psi_acc[p];
+        }
+    });
+}
+
+template <typename Real, typename Eval>
+BasicVelocityField<Real> evaluate_field_tiles(
+    const RegularGrid& grid,
+    const Matrix<bool, Dynamic, Dynamic>& inside,
+    double u_inf,
+    double v_inf,
+    int n_threads,
+    bool with_psi,
+    const Eval& eval) {
+
+    BasicVelocityField<Real> field;
+    evaluate_field_tiles_into(field, grid, inside, u_inf, v_inf, n_threads, with_psi, eval);
+    return field;
+}
+
+// adds the velocity of panels 0..n at m points, panels outermost so every
+// point sums them in index order
+template <typename Real>
+void accumulate_panel_field(
+    const PanelFrames& f,
+    const VectorXd& mu,
+    const VectorXd& mu_psi,
+    int n,
+    const Real* __restrict px, const Real* __restrict pz, int m,
+    Real* __restrict u_acc, Real* __restrict v_acc, Real* __restrict psi_acc) {
+
+    for (int k = 0; k <= n; ++k) {
+        Real x1 = Real(f.x1(k)), z1 = Real(f.z1(k));
+        Real x2 = Real(f.x2(k)), z2 = Real(f.z2(k));
+        Real ca = Real(f.cos_a(k)), sa = Real(f.sin_a(k));
+        Real mu_k = Real(mu(k));
+
+        for (int p = 0; p < m; ++p) {
+            Real u, v;
+            doublet_unit_velocity(px[p], pz[p], x1, z1, x2, z2, ca, sa, u, v);
+            u_acc[p] += mu_k * u;
+            v_acc[p] += mu_k * v;
+        }
+
+        if (psi_acc) {
+            Real mu_psi_k = Real(mu_psi(k));
+            for (int p = 0; p < m; ++p) {
+                psi_acc[p] += mu_psi_k * doublet_unit_stream(px[p], pz[p], x1, z1, x2, z2);
+            }
+        }
+    }
+}
+
+struct FieldScratch {
+    Matrix<bool, Dynamic, Dynamic> inside;
+    MaskScratch mask;
+    PanelFrames frames;
+    VectorXd mu_gauge_free;
+    MatrixXd body;
+};
+
+// tiled direct evaluation; bit-identical to the single-threaded path
+template <typename Real>
+void calculate_velocity_tiled_into(
+    BasicVelocityField<Real>& field,
+    FieldScratch& scratch,
+    const RegularGrid& grid,
+    const VectorXd& mu,
+    const MatrixXd& panel_coord,
+    double u_fs,
+    double aoa,
+    int n,
+    int n_threads,
+    bool with_psi) {
+
+    scratch.body = panel_coord.topRows(n);
+    mesh_interior_mask_into(grid, scratch.body, scratch.inside, scratch.mask);
+    panel_frames_into(panel_coord, n + 1, scratch.frames);
+
+    // psi (and everything in float) is summed with the body gauge removed
+    const bool single = std::is_same<Real, float>::value;
+    VectorXd& mu_psi = scratch.mu_gauge_free;
+    if (with_psi || single) {
+        mu_psi = mu;
+        mu_psi.head(n).array() -= mu.head(n).mean();
+    }
+    const VectorXd& mu_vel = single ? mu_psi : mu;
+    const PanelFrames& f = scratch.frames;
+
+    auto eval = [&](const Real* px, const Real* pz, int m, Real* u_acc, Real* v_acc, Real* psi_acc) {
+        accumulate_panel_field(f, mu_vel, mu_psi, n, px, pz, m, u_acc, v_acc, psi_acc);
+    };
+
+    evaluate_field_tiles_into(field, grid, scratch.inside, u_fs * cos(aoa), u_fs * sin(aoa), n_threads, with_psi, eval);
+}
+
+template <typename Real>
+BasicVelocityField<Real> calculate_velocity_tiled_as(
+    const RegularGrid& grid,
+    const VectorXd& mu,
+    const MatrixXd& panel_coord,
+    double u_fs,
+    double aoa,
+    int n,
+    int n_threads,
+    bool with_psi) {
+
+    BasicVelocityField<Real> field;
+    FieldScratch scratch;
+    calculate_velocity_tiled_into(field, scratch, grid, mu, panel_coord, u_fs, aoa, n, n_threads, with_psi);
+    return field;
+}
+
+inline VelocityField calculate_velocity_tiled(
+    const RegularGrid& grid,
+    const VectorXd& mu,
+    const MatrixXd& panel_coord,
+    double u_fs,
+    double aoa,
+    int n,
+    int n_threads,
+    bool with_psi = false) {
+
+    return calculate_velocity_tiled_as<double>(grid, mu, panel_coord, u_fs, aoa, n, n_threads, with_psi);
+}
+
+inline VelocityField calculate_velocity(
+    const RegularGrid& grid,
+    const VectorXd& mu, 
+    const MatrixXd& panel_coord,
+    const double& u_fs,
+    const double& aoa, 
+    const int& n) {
+
+    return calculate_velocity_tiled(grid, mu, panel_coord, u_fs, aoa, n, 1);
+}
+
+// barnes-hut treecode: a doublet panel is vortices -mu and +mu at its ends,
+// so a cluster about c has the expansion
+//   u - i v = i / (2 pi) * sum_p a_p / (z - c)^(p + 1), a_p = sum_j gamma_j (z_j - c)^p
+// clusters are contiguous index ranges; near ones are summed exactly
+struct PanelTreeNode {
+    int begin, end;
+    int left, right;
+    double cx, cz;
+    double radius;
+};
+
+struct PanelTree {
+    std::vector<PanelTreeNode> nodes;
+    int order = 0;
+    double theta = 0.5;
+    std::vector<std::complex<double>> coeffs;
+};
+
+const int PANEL_TREE_LEAF = 16;
+
+inline int build_panel_tree_node(PanelTree& tree, const PanelFrames& f, int begin, int end) {
+    PanelTreeNode node{begin, end, -1, -1, 0.0, 0.0, 0.0};
+
+    for (int k = begin; k < end; ++k) {
+        node.cx += f.x1(k) + f.x2(k);
+        node.cz += f.z1(k) + f.z2(k);
+    }
+    node.cx /= 2 * (end - begin);
+    node.cz /= 2 * (end - begin);
+
+    for (int k = begin; k < end; ++k) {
+        node.radius = std::max(node.radius, std::hypot(f.x1(k) - node.cx, f.z1(k) - node.cz));
+        node.radius = std::max(node.radius, std::hypot(f.x2(k) - node.cx, f.z2(k) - node.cz));
+    }
+
+    int id = tree.nodes.size();
+    tree.nodes.push_back(node);
+
+    if (end - begin > PANEL_TREE_LEAF) {
+        int mid = begin + (end - begin) / 2;
+        int left = build_panel_tree_node(tree, f, begin, mid);
+        int right = build_panel_tree_node(tree, f, mid, end);
+        tree.nodes[id].left = left;
+        tree.nodes[id].right = right;
+    }
+    return id;
+}
+
+inline PanelTree build_panel_tree(const PanelFrames& f, double tolerance, double theta = 0.5) {
+    PanelTree tree;
+    tree.theta = theta;
+    tree.order = std::clamp((int)std::ceil(std::log(tolerance) / std::log(theta)), 1, 40);
+    build_panel_tree_node(tree, f, 0, f.x1.size());
+    return tree;
+}
+
+// multipole moments for the current strengths; O(n * order)
+inline void panel_tree_moments(PanelTree& tree, const PanelFrames& f, const VectorXd& mu) {
+    int order = tree.order;
+    tree.coeffs.assign(tree.nodes.size() * order, 0.0);
+
+    for (size_t id = 0; id < tree.nodes.size(); ++id) {
+        const PanelTreeNode& node = tree.nodes[id];
+        std::complex<double>* a = &tree.coeffs[id * order];
+        std::complex<double> c(node.cx, node.cz);
+
+        for (int k = node.begin; k < node.end; ++k) {
+            std::complex<double> d1 = std::complex<double>(f.x1(k), f.z1(k)) - c;
+            std::complex<double> d2 = std::complex<double>(f.x2(k), f.z2(k)) - c;
+            std::complex<double> w1(-mu(k), 0.0), w2(mu(k), 0.0);
+            for (int p = 0; p < order; ++p) {
+                a[p] += w1 + w2;
+                w1 *= d1;
+                w2 *= d2;
+            }
+        }
+    }
+}
+
+// induced velocity at (px, pz); returns the number of direct evaluations
+inline int panel_tree_velocity(
+    const PanelTree& tree,
+    const PanelFrames& f,
+    const VectorXd& mu,
+    double px, double pz,
+    double& u_out, double& v_out) {
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    std::complex<double> far(0.0, 0.0);
+    double u_near = 0.0, v_near = 0.0;
+    int direct = 0;
+
+    while (top > 0) {
+        const PanelTreeNode& node = tree.nodes[stack[--top]];
+        double dx = px - node.cx, dz = pz - node.cz;
+        double dist = std::sqrt(dx * dx + dz * dz);
+
+        if (node.radius < tree.theta * dist) {
+            std::complex<double> w = 1.0 / std::complex<double>(dx, dz);
+            const std::complex<double>* a = &tree.coeffs[(&node - tree.nodes.data()) * tree.order];
+            std::complex<double> sum(0.0, 0.0);
+            for (int p = tree.order - 1; p >= 0; --p) sum = (sum + a[p]) * w;
+            far += sum;
+        } else if (node.left < 0) {
+            direct += node.end - node.begin;
+            for (int k = node.begin; k < node.end; ++k) {
+                double u, v;
+                doublet_unit_velocity(px, pz, f.x1(k), f.z1(k), f.x2(k), f.z2(k),
+                                      f.cos_a(k), f.sin_a(k), u, v);
+                u_near += mu(k) * u;
+                v_near += mu(k) * v;
+            }
+        } else {
+            stack[top++] = node.right;
+            stack[top++] = node.left;
+        }
+    }
+
+    // u - i v = i far / (2 pi)
+    u_out = u_near - far.imag() / (2 * M_PI);
+    v_out = v_near - far.real() / (2 * M_PI);
+    return direct;
+}
+
+// velocity field with the treecode; tolerance bounds each cluster's
+// relative truncation error
+inline VelocityField calculate_velocity_tree(
+    const RegularGrid& grid,
+    const VectorXd& mu,
+    const MatrixXd& panel_coord,
+    double u_fs,
+    double aoa,
+    int n,
+    double tolerance,
+    int n_threads,
+    double* kernel_evals = nullptr) {
+
+    Matrix<bool, Dynamic, Dynamic> inside = mesh_interior_mask(grid, panel_coord.topRows(n));
+    PanelFrames f = panel_frames(panel_coord, n + 1);
+    PanelTree tree = build_panel_tree(f, tolerance);
+
+    VectorXd mu_eval = remove_body_gauge(mu, n);
+    panel_tree_moments(tree, f, mu_eval);
+
+    std::atomic<long> direct{0};
+    auto eval = [&](const double* px, const double* pz, int m, double* u_acc, double* v_acc, double*) {
+        long tile_direct = 0;
+        for (int p = 0; p < m; ++p) {
+            double u, v;
+            tile_direct += panel_tree_velocity(tree, f, mu_eval, px[p], pz[p], u, v);
+            u_acc[p] += u;
+            v_acc[p] += v;
+        }
+        direct += tile_direct;
+    };
+
+    VelocityField field = evaluate_field_tiles<double>(
+        grid, inside, u_fs * cos(aoa), u_fs * sin(aoa), n_threads, false, eval);
+    if (kernel_evals) *kernel_evals = double(direct.load());
+    return field;
+}
+
+// influence of every body panel on the outside points, independent of AoA:
+// a new solution's field is one matrix-vector product plus the wake term.
+// 16 bytes per (point, panel), so opt-in and capped at max_bytes
+const size_t FIELD_CACHE_MAX_BYTES = size_t(64) << 20;
+
+struct FieldInfluenceCache {
+    MatrixXd body;
+    RegularGrid grid;
+    std::vector<Index> outside;
+    VectorXd px, pz;
+    MatrixXd gu, gv;
+    size_t max_bytes = FIELD_CACHE_MAX_BYTES;
+};
+
+inline size_t field_cache_bytes(const FieldInfluenceCache& cache) {
+    return (cache.gu.size() + cache.gv.size() + cache.px.size() + cache.pz.size()) * sizeof(double)
+           + cache.outside.size() * sizeof(Index);
+}
+
+inline bool field_cache_fits(const FieldInfluenceCache& cache, const RegularGrid& grid, int n) {
+    double points = double(grid.nx) * grid.nz;
+    return points * (2.0 * n + 2.0) * sizeof(double) + points * sizeof(Index) <= double(cache.max_bytes);
+}
+
+inline void release_field_cache(FieldInfluenceCache& cache) {
+    size_t max_bytes = cache.max_bytes;
+    cache = FieldInfluenceCache();
+    cache.max_bytes = max_bytes;
+}
+
+inline bool field_cache_matches(
+    const FieldInfluenceCache& cache,
+    const RegularGrid& grid,
+    const MatrixXd& panel_coord,
+    int n) {
+
+    if (!same_grid(cache.grid, grid) || cache.body.rows() != n + 1) return false;
+    return cache.body == panel_coord.topRows(n + 1);
+}
+
+inline void build_field_cache(
+    FieldInfluenceCache& cache,
+    const RegularGrid& grid,
+    const MatrixXd& panel_coord,
+    int n) {
+
+    Matrix<bool, Dynamic, Dynamic> inside = mesh_interior_mask(grid, panel_coord.topRows(n));
+
+    cache.outside.clear();
+    for (Index k = 0; k < inside.size(); ++k) {
+        if (!inside(k)) cache.outside.push_back(k);
+    }
+
+    Index m = cache.outside.size();
+    cache.px.resize(m);
+    cache.pz.resize(m);
+    for (Index i = 0; i < m; ++i) {
+        cache.px(i) = grid.x(cache.outside[i] / grid.nz);
+        cache.pz(i) = grid.z(cache.outside[i] % grid.nz);
+    }
+
+    PanelFrames f = panel_frames(panel_coord, n);
+    cache.gu.resize(m, n);
+    cache.gv.resize(m, n);
+
+    const double* px = cache.px.data();
+    const double* pz = cache.pz.data();
+    for (int k = 0; k < n; ++k) {
+        double x1 = f.x1(k), z1 = f.z1(k);
+        double x2 = f.x2(k), z2 = f.z2(k);
+        double ca = f.cos_a(k), sa = f.sin_a(k);
+        double* gu = cache.gu.col(k).data();
+        double* gv = cache.gv.col(k).data();
+
+        for (Index i = 0; i < m; ++i) {
+            doublet_unit_velocity(px[i], pz[i], x1, z1, x2, z2, ca, sa, gu[i], gv[i]);
+        }
+    }
+
+    cache.body = panel_coord.topRows(n + 1);
+    cache.grid = grid;
+}
+
+// calculate_velocity, rebuilding the operator only when body or mesh change
+inline VelocityField calculate_velocity_cached(
+    FieldInfluenceCache& cache,
+    const RegularGrid& grid,
+    const VectorXd& mu,
+    const MatrixXd& panel_coord,
+    double u_fs,
+    double aoa,
+    int n) {
+
+    if (!field_cache_matches(cache, grid, panel_coord, n)) {
+        build_field_cache(cache, grid, panel_coord, n);
+    }
+
+    VectorXd u_out = cache.gu * mu.head(n);
+    VectorXd v_out = cache.gv * mu.head(n);
+
+    // the wake moves with AoA so it is evaluated directly
+    PanelFrames wake = panel_frames(panel_coord.bottomRows(2), 1);
+    double u_inf = u_fs * cos(aoa);
+    double v_inf = u_fs * sin(aoa);
+    double mu_w = mu(n);
+
+    Index m = cache.outside.size();
+    for (Index i = 0; i < m; ++i) {
+        double u, v;
+        doublet_unit_velocity(cache.px(i), cache.pz(i),
+                              wake.x1(0), wake.z1(0), wake.x2(0), wake.z2(0),
+                              wake.cos_a(0), wake.sin_a(0), u, v);
+        u_out(i) += u_inf + mu_w * u;
+        v_out(i) += v_inf + mu_w * v;
+    }
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    VelocityField field{MatrixXd::Constant(grid.nz, grid.nx, nan),
+                        MatrixXd::Constant(grid.nz, grid.nx, nan), MatrixXd()};
+    for (Index i = 0; i < m; ++i) {
+        field.u(cache.outside[i]) = u_out(i);
+        field.v(cache.outside[i]) = v_out(i);
+    }
+    return field;
+}
+
+// field whose grid points are evaluated the first time a stencil touches
+// them, in runs along a row; same values as calculate_velocity
+const int LAZY_BLOCK_ROWS = 1;
+const int LAZY_BLOCK_COLS = 8;
+
+struct LazyVelocityField {
+    RegularGrid grid;
+    PanelFrames frames;
+    VectorXd mu;
+    int n = 0;
+    double u_inf = 0.0, v_inf = 0.0;
+    VelocityField field;                    // NaN inside the body and until evaluated
+    Matrix<bool, Dynamic, Dynamic> inside;
+    Matrix<bool, Dynamic, Dynamic> ready;   // per block
+    long evaluated = 0;
+};
+
+inline LazyVelocityField lazy_velocity_field(
+    const RegularGrid& grid,
+    const VectorXd& mu,
+    const MatrixXd& panel_coord,
+    double u_fs,
+    double aoa,
+    int n) {
+
+    double nan = std::numeric_limits<double>::quiet_NaN();
+
+    LazyVelocityField lazy;
+    lazy.grid = grid;
+    lazy.frames = panel_frames(panel_coord, n + 1);
+    lazy.mu = mu;
+    lazy.n = n;
+    lazy.u_inf = u_fs * cos(aoa);
+    lazy.v_inf = u_fs * sin(aoa);
+    lazy.field.u = MatrixXd::Constant(grid.nz, grid.nx, nan);
+    lazy.field.v = MatrixXd::Constant(grid.nz, grid.nx, nan);
+    lazy.inside = mesh_interior_mask(grid, panel_coord.topRows(n));
+    lazy.ready = Matrix<bool, Dynamic, Dynamic>::Constant(
+        (grid.nz + LAZY_BLOCK_ROWS - 1) / LAZY_BLOCK_ROWS,
+        (grid.nx + LAZY_BLOCK_COLS - 1) / LAZY_BLOCK_COLS, false);
+    return lazy;
+}
+
+inline void lazy_field_fill_block(LazyVelocityField& lazy, int bi, int bj) {
+    if (lazy.ready(bi, bj)) return;
+    lazy.ready(bi, bj) = true;
+
+    const int cap = LAZY_BLOCK_ROWS * LAZY_BLOCK_COLS;
+    double px[cap] = {}, pz[cap] = {};   // see evaluate_field_tiles_into
+    double u_acc[cap], v_acc[cap];
+    Index idx[cap];
+    int m = 0;
+
+    int r0 = bi * LAZY_BLOCK_ROWS, c0 = bj * LAZY_BLOCK_COLS;
+    int r1 = std::min(r0 + LAZY_BLOCK_ROWS, lazy.grid.nz);
+    int c1 = std::min(c0 + LAZY_BLOCK_COLS, lazy.grid.nx);
+    for (int j = c0; j < c1; ++j) {
+        for (int i = r0; i < r1; ++i) {
+            if (lazy.inside(i, j)) continue;
+            px[m] = lazy.grid.x(j);
+            pz[m] = lazy.grid.z(i);
+            u_acc[m] = lazy.u_inf;
+            v_acc[m] = lazy.v_inf;
+            idx[m] = i + Index(j) * lazy.grid.nz;
+            ++m;
+        }
+    }
+
+    accumulate_panel_field<double>(lazy.frames, lazy.mu, lazy.mu, lazy.n, px, pz, m, u_acc, v_acc, nullptr);
+    for (int p = 0; p < m; ++p) {
+        lazy.field.u(idx[p]) = u_acc[p];
+        lazy.field.v(idx[p]) = v_acc[p];
+    }
+    lazy.evaluated += m;
+}
+
+inline void lazy_field_fill_cell(LazyVelocityField& lazy, int i, int j) {
+    int bi0 = i / LAZY_BLOCK_ROWS, bi1 = (i + 1) / LAZY_BLOCK_ROWS;
+    int bj0 = j / LAZY_BLOCK_COLS, bj1 = (j + 1) / LAZY_BLOCK_COLS;
+    lazy_field_fill_block(lazy, bi0, bj0);
+    if (bj1 != bj0) lazy_field_fill_block(lazy, bi0, bj1);
+    if (bi1 != bi0) {
+        lazy_field_fill_block(lazy, bi1, bj0);
+        if (bj1 != bj0) lazy_field_fill_block(lazy, bi1, bj1);
+    }
+}